@@ -324,24 +324,6 @@ void RemoveLeaf(bvh_tree *Tree, i32 NodeIndex)
     Tree->FreeList = NodeIndex;
 }
 
-aabb TransformAABB(aabb A, m4x4 ModelMatrix)
-{
-    aabb Result;
-    for (i32 i = 0; i < 3; ++i)
-    {
-        Result.Min[i] = ModelMatrix[i][3];
-        Result.Max[i] = ModelMatrix[i][3];
-        for (i32 j = 0; j < 3; ++j)
-        {
-            float e = ModelMatrix[i][j] * A.Min[j];
-            float f = ModelMatrix[i][j] * A.Max[j];
-            Result.Min[i] += (e < f ? e : f);
-            Result.Max[i] += (e < f ? f : e);
-        }
-    }
-    return Result;
-}
-
 aabb GrowAABB(aabb A, float Factor)
 {
     aabb Result;
@@ -367,7 +349,13 @@ void UpdateBVH(bvh_tree *Tree)
         // Save a local copy of entindex since we may remove this leaf and it gets cleared to zero.
         entity_handle EntityIndex = Node->Entity;
         rigid_body *Entity = GetEntityByHandle(EntityIndex);
-        aabb TransformedBoundingVolume = TransformAABB(Entity->BoundingVolume, Entity->ModelMatrix);
+        if (Entity->IsSleeping)
+        {
+            continue;
+        }
+
+        // The world bounds are only recalculated for bodies that moved.
+        aabb TransformedBoundingVolume = UpdateBodyBounds(EntityIndex);
         ASSERT(!IsZeroVector(TransformedBoundingVolume.Min) ||
                !IsZeroVector(TransformedBoundingVolume.Max));
         
@@ -382,9 +370,7 @@ void UpdateBVH(bvh_tree *Tree)
 
 void InsertEntity(bvh_tree *Tree, entity_handle EntityIndex)
 {
-    rigid_body *Entity = GetEntityByHandle(EntityIndex);
-    Entity->RecalculateModelMatrix();
-    aabb BV = TransformAABB(Entity->BoundingVolume, Entity->ModelMatrix);
+    aabb BV = UpdateBodyBounds(EntityIndex);
     InsertLeaf(Tree, GrowAABB(BV, Tree->GrowFactor), EntityIndex);
 }
 
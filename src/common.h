@@ -74,6 +74,12 @@ void* PlatformReserveMemory(u64 Size);
 void PlatformCommitMemory(void *Memory, u64 Size);
 void PlatformReleaseMemory(void *Memory);
 
+// Work is run by the platform worker threads and by the thread waiting for it to complete.
+// Entries added between two PlatformCompleteAllWork calls may run in any order.
+typedef void work_queue_callback(void *Data);
+void PlatformAddWork(work_queue_callback *Callback, void *Data);
+void PlatformCompleteAllWork();
+
 inline arena CreateArena(u64 Size = GIGABYTES(1))
 {
     arena Arena;
@@ -95,9 +101,32 @@ inline void* GetArenaEnd(arena *Arena)
     return Result;
 }
 
+// Scoped scratch allocations, everything pushed after BeginTemporaryMemory is freed by
+// the matching EndTemporaryMemory.
+struct temporary_memory
+{
+    arena *Arena;
+    u64 AllocPosition;
+};
+
+inline temporary_memory BeginTemporaryMemory(arena *Arena)
+{
+    temporary_memory Result;
+    Result.Arena = Arena;
+    Result.AllocPosition = Arena->AllocPosition;
+    return Result;
+}
+
+inline void EndTemporaryMemory(temporary_memory Temp)
+{
+    ASSERT(Temp.Arena->AllocPosition >= Temp.AllocPosition);
+    Temp.Arena->AllocPosition = Temp.AllocPosition;
+}
+
 #define ArenaPushType(_arena, _type) (_type *)ArenaPushSize(_arena, sizeof(_type))
 #define ArenaPushArray(_arena, _count, _type) (_type *)ArenaPushSize(_arena, sizeof(_type) * (_count))
 #define ArenaPushList(_arena, _count, _type) (_type *)ArenaPushList_(_arena, sizeof(_type), (_count))
+#define ArenaPushArrayAligned(_arena, _count, _type) (_type *)ArenaPushSizeAligned(_arena, sizeof(_type) * (_count), alignof(_type))
 
 inline void *ArenaPushSize(arena *Arena, u64 Size)
 {
@@ -116,6 +145,15 @@ inline void *ArenaPushSize(arena *Arena, u64 Size)
     return Result;
 }
 
+// Alignment has to be a power of two.
+inline void *ArenaPushSizeAligned(arena *Arena, u64 Size, u64 Alignment)
+{
+    u64 Address = (u64)Arena->Base + Arena->AllocPosition;
+    u64 Padding = (Alignment - (Address & (Alignment - 1))) & (Alignment - 1);
+    Arena->AllocPosition += Padding;
+    return ArenaPushSize(Arena, Size);
+}
+
 inline void *ArenaPushList_(arena *Arena, usize ElementSize, usize Capacity)
 {
     void *Array = ArenaPushSize(Arena, sizeof(list_header) + ElementSize * Capacity);
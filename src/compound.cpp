@@ -0,0 +1,213 @@
+//
+// Compounds are rigid bodies made out of several hulls. The children are kept in a small
+// static BVH so that collision tests only have to run SAT on the overlapping ones.
+//
+
+static i32 BuildCompoundNode(compound *Compound, i32 *Children, i32 Count)
+{
+    i32 NodeIndex = Compound->NodeCount++;
+    compound_node *Node = Compound->Nodes + NodeIndex;
+
+    Node->Bounds = Compound->Children[Children[0]].Bounds;
+    for (i32 i = 1; i < Count; ++i)
+    {
+        Node->Bounds = Union(Node->Bounds, Compound->Children[Children[i]].Bounds);
+    }
+
+    if (Count == 1)
+    {
+        Node->Child = Children[0];
+        Node->RightNode = -1;
+        return NodeIndex;
+    }
+
+    // Split at the median along the longest axis.
+    v3 Size = Node->Bounds.Max - Node->Bounds.Min;
+    i32 Axis = 0;
+    if (Size[1] > Size[Axis]) Axis = 1;
+    if (Size[2] > Size[Axis]) Axis = 2;
+
+    for (i32 i = 1; i < Count; ++i)
+    {
+        i32 Child = Children[i];
+        aabb Bounds = Compound->Children[Child].Bounds;
+        float Center = Bounds.Min[Axis] + Bounds.Max[Axis];
+
+        i32 j = i;
+        for (; j > 0; --j)
+        {
+            aabb Other = Compound->Children[Children[j-1]].Bounds;
+            if (Other.Min[Axis] + Other.Max[Axis] <= Center)
+            {
+                break;
+            }
+            Children[j] = Children[j-1];
+        }
+        Children[j] = Child;
+    }
+
+    i32 LeftCount = Count / 2;
+    Node->Child = -1;
+    BuildCompoundNode(Compound, Children, LeftCount);
+    i32 RightNode = BuildCompoundNode(Compound, Children + LeftCount, Count - LeftCount);
+
+    // Children may have been pushed after Node, so index again.
+    Compound->Nodes[NodeIndex].RightNode = RightNode;
+    return NodeIndex;
+}
+
+compound *BuildCompound(arena *Arena, compound_child *Children, i32 ChildCount)
+{
+    ASSERT(ChildCount > 0);
+
+    compound *Result = ArenaPushType(Arena, compound);
+    Result->ChildCount = ChildCount;
+    Result->Children = ArenaPushArray(Arena, ChildCount, compound_child);
+    Result->Nodes = ArenaPushArray(Arena, 2 * ChildCount - 1, compound_node);
+
+    temporary_memory Temp = BeginTemporaryMemory(TemporaryArena());
+    i32 *Indices = ArenaPushArray(TemporaryArena(), ChildCount, i32);
+    for (i32 i = 0; i < ChildCount; ++i)
+    {
+        compound_child *Child = Result->Children + i;
+        *Child = Children[i];
+        Indices[i] = i;
+
+        aabb Bounds;
+        Bounds.Min = V3(FLT_MAX, FLT_MAX, FLT_MAX);
+        Bounds.Max = -Bounds.Min;
+        for (i32 VertexIndex = 0; VertexIndex < Child->Hull->VertexCount; ++VertexIndex)
+        {
+            v3 Vertex = ScaledVertex(Child->Hull, Child->Scale, VertexIndex);
+            for (i32 Axis = 0; Axis < 3; ++Axis)
+            {
+                Bounds.Min[Axis] = Min(Bounds.Min[Axis], Vertex[Axis]);
+                Bounds.Max[Axis] = Max(Bounds.Max[Axis], Vertex[Axis]);
+            }
+        }
+        Child->Bounds = TransformAABB(Bounds, Child->Transform);
+    }
+
+    BuildCompoundNode(Result, Indices, ChildCount);
+    ASSERT(Result->NodeCount == 2 * ChildCount - 1);
+
+    EndTemporaryMemory(Temp);
+    return Result;
+}
+
+// Bounds are in the local space of the compound. Returns the number of overlapping
+// children, only the first MaxChildren are written.
+i32 QueryCompound(compound *Compound, aabb Bounds, i32 *Children, i32 MaxChildren)
+{
+    i32 Count = 0;
+    i32 StackCount = 0;
+    i32 Stack[64];
+    Stack[StackCount++] = 0;
+    while (StackCount > 0)
+    {
+        compound_node *Node = Compound->Nodes + Stack[--StackCount];
+        if (!IntersectAABBAABB(Node->Bounds, Bounds))
+        {
+            continue;
+        }
+
+        if (Node->Child != -1)
+        {
+            if (Count < MaxChildren)
+            {
+                Children[Count] = Node->Child;
+            }
+            Count++;
+        }
+        else
+        {
+            ASSERT(StackCount + 2 <= ARRAY_SIZE(Stack));
+            Stack[StackCount++] = Node->RightNode;
+            Stack[StackCount++] = (i32)(Node - Compound->Nodes) + 1;
+        }
+    }
+    return Count;
+}
+
+// Inertia tensors are converted to covariance to apply the scale, since the covariance
+// transforms like the points themselves.
+static mass_properties ScaleMassProperties(mass_properties Properties, v3 Scale)
+{
+    mass_properties Result = Properties;
+    float Determinant = Scale.x * Scale.y * Scale.z;
+    Result.Volume *= Determinant;
+    Result.Centroid = Hadamard(Properties.Centroid, Scale);
+
+    float HalfTrace = 0.5f * (Properties.Inertia[0][0] + Properties.Inertia[1][1] + Properties.Inertia[2][2]);
+    m3x3 Covariance;
+    for (i32 i = 0; i < 3; ++i)
+    {
+        for (i32 j = 0; j < 3; ++j)
+        {
+            Covariance[i][j] = (i == j ? HalfTrace : 0.f) - Properties.Inertia[i][j];
+            Covariance[i][j] *= Determinant * Scale[i] * Scale[j];
+        }
+    }
+
+    float Trace = Covariance[0][0] + Covariance[1][1] + Covariance[2][2];
+    for (i32 i = 0; i < 3; ++i)
+    {
+        for (i32 j = 0; j < 3; ++j)
+        {
+            Result.Inertia[i][j] = (i == j ? Trace : 0.f) - Covariance[i][j];
+        }
+    }
+    return Result;
+}
+
+// Combined mass properties of all children, assuming they share the same density.
+mass_properties ComputeCompoundMassProperties(compound *Compound)
+{
+    mass_properties Result = {};
+
+    temporary_memory Temp = BeginTemporaryMemory(TemporaryArena());
+    mass_properties *Children = ArenaPushArray(TemporaryArena(), Compound->ChildCount, mass_properties);
+    v3 WeightedCentroid = {};
+    for (i32 i = 0; i < Compound->ChildCount; ++i)
+    {
+        compound_child *Child = Compound->Children + i;
+        mass_properties Properties = ComputeHullMassProperties(Child->Hull);
+        Properties = ScaleMassProperties(Properties, Child->Scale);
+
+        // Rotate the inertia into the compound frame.
+        m3x3 R = RotationMatrix3(Child->Transform.Rotation);
+        Properties.Inertia = R * Properties.Inertia * Transpose(R);
+        Properties.Centroid = PointToWorldSpace(Properties.Centroid, Child->Transform);
+
+        Children[i] = Properties;
+        Result.Volume += Properties.Volume;
+        WeightedCentroid += Properties.Centroid * Properties.Volume;
+    }
+
+    if (Result.Volume <= 0.f)
+    {
+        EndTemporaryMemory(Temp);
+        return Result;
+    }
+
+    Result.Centroid = WeightedCentroid / Result.Volume;
+
+    // Parallel axis theorem to move every child's inertia to the combined centroid.
+    for (i32 ChildIndex = 0; ChildIndex < Compound->ChildCount; ++ChildIndex)
+    {
+        mass_properties *Child = Children + ChildIndex;
+        v3 d = Child->Centroid - Result.Centroid;
+        float DistanceSq = Dot(d, d);
+        for (i32 i = 0; i < 3; ++i)
+        {
+            for (i32 j = 0; j < 3; ++j)
+            {
+                Result.Inertia[i][j] += Child->Inertia[i][j] +
+                    Child->Volume * ((i == j ? DistanceSq : 0.f) - d[i] * d[j]);
+            }
+        }
+    }
+
+    EndTemporaryMemory(Temp);
+    return Result;
+}
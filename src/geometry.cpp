@@ -52,7 +52,7 @@ polygon ClipPolygonBack(polygon Polygon, plane ClipPlane, i32 FaceIndex)
             {
                 v3 Intersection = EdgePlaneIntersection(A.Position, B.Position, ClipPlane);
                 ASSERT(ClassifyPointToPlane(Intersection, ClipPlane) == PointPlane_Inside);
-                Output[OutIndex++] = { Intersection, FaceIndex };
+                Output[OutIndex++] = { Intersection, 2*FaceIndex + 1 };
             }
         }
         else if (BSide == PointPlane_Back)
@@ -61,7 +61,7 @@ polygon ClipPolygonBack(polygon Polygon, plane ClipPlane, i32 FaceIndex)
             {
                 v3 Intersection = EdgePlaneIntersection(A.Position, B.Position, ClipPlane);
                 ASSERT(ClassifyPointToPlane(Intersection, ClipPlane) == PointPlane_Inside);
-                Output[OutIndex++] = { Intersection, FaceIndex };
+                Output[OutIndex++] = { Intersection, 2*FaceIndex };
             }
             else if (ASide == PointPlane_Inside)
             {
@@ -84,25 +84,26 @@ polygon ClipPolygonBack(polygon Polygon, plane ClipPlane, i32 FaceIndex)
     return Result;
 }
 
-v3 HullSupport(hull *Hull, v3 Direction)
+v3 HullSupport(hull *Hull, v3 Scale, v3 Direction)
 {
-    v3 Result = {};
+    // Support of the scaled hull is the scaled support in the scaled direction.
+    v3 ScaledDirection = Hadamard(Direction, Scale);
+    i32 Index = 0;
     float Max = -FLT_MAX;
     for (i32 i = 0; i < Hull->VertexCount; ++i)
     {
-        v3 Vertex = Hull->Vertices[i];
-        float Projection = Dot(Vertex, Direction);
+        float Projection = Dot(Hull->Vertices[i], ScaledDirection);
         if (Projection > Max)
         {
             Max = Projection;
-            Result = Vertex;
+            Index = i;
         }
     }
 
-    return Result;
+    return ScaledVertex(Hull, Scale, Index);
 }
 
-face_query SATQueryFaces(hull *A, transform TA, hull *B, transform TB)
+face_query SATQueryFaces(hull *A, v3 ScaleA, transform TA, hull *B, v3 ScaleB, transform TB)
 {
     face_query Result;
     Result.Index = -1;
@@ -113,12 +114,12 @@ face_query SATQueryFaces(hull *A, transform TA, hull *B, transform TB)
          Index < A->FaceCount;
          ++Index)
     {
-        plane Plane = A->Planes[Index];
+        plane Plane = ScaledPlane(A, ScaleA, Index);
         v3 BSpaceNormal = DirectionToLocalSpaceOfB(Plane.Normal, TA, TB);
 
         i32 VertexAIndex = A->Edges[A->Faces[Index].Edge].Origin;
-        v3 VertexA = PointToLocalSpaceOfB(A->Vertices[VertexAIndex], TA, TB);
-        v3 VertexB = HullSupport(B, -BSpaceNormal);
+        v3 VertexA = PointToLocalSpaceOfB(ScaledVertex(A, ScaleA, VertexAIndex), TA, TB);
+        v3 VertexB = HullSupport(B, ScaleB, -BSpaceNormal);
         float Separation = Dot(BSpaceNormal, VertexB - VertexA);
 
         if (Separation > Result.Separation)
@@ -133,7 +134,7 @@ face_query SATQueryFaces(hull *A, transform TA, hull *B, transform TB)
 }
 
 // @TODO: This can be improved by using gauss maps for edge pruning (as per Valve GDC paper)
-edge_query SATQueryEdges(hull *A, transform TA, hull *B, transform TB)
+edge_query SATQueryEdges(hull *A, v3 ScaleA, transform TA, hull *B, v3 ScaleB, transform TB)
 {
     edge_query Result;
     Result.EdgeA = -1;
@@ -141,7 +142,7 @@ edge_query SATQueryEdges(hull *A, transform TA, hull *B, transform TB)
     Result.Normal = {};
     Result.Separation = -FLT_MAX;
 
-    v3 C1 = PointToLocalSpaceOfB(A->Centroid, TA, TB);
+    v3 C1 = PointToLocalSpaceOfB(Hadamard(A->Centroid, ScaleA), TA, TB);
 
     for (i32 Index1 = 0; Index1 < A->EdgeCount; Index1 += 2)
     {
@@ -151,8 +152,8 @@ edge_query SATQueryEdges(hull *A, transform TA, hull *B, transform TB)
         ASSERT(Edge1->Twin == (Index1 + 1));
         ASSERT(Twin1->Twin == Index1);
 
-        v3 P1 = PointToLocalSpaceOfB(A->Vertices[Edge1->Origin], TA, TB);
-        v3 Q1 = PointToLocalSpaceOfB(A->Vertices[Twin1->Origin], TA, TB);
+        v3 P1 = PointToLocalSpaceOfB(ScaledVertex(A, ScaleA, Edge1->Origin), TA, TB);
+        v3 Q1 = PointToLocalSpaceOfB(ScaledVertex(A, ScaleA, Twin1->Origin), TA, TB);
         v3 E1 = Q1 - P1;
 
         for (i32 Index2 = 0; Index2 < B->EdgeCount; Index2 += 2)
@@ -163,8 +164,8 @@ edge_query SATQueryEdges(hull *A, transform TA, hull *B, transform TB)
             ASSERT(Edge2->Twin == (Index2 + 1));
             ASSERT(Twin2->Twin == Index2);
 
-            v3 P2 = B->Vertices[Edge2->Origin];
-            v3 Q2 = B->Vertices[Twin2->Origin];
+            v3 P2 = ScaledVertex(B, ScaleB, Edge2->Origin);
+            v3 Q2 = ScaledVertex(B, ScaleB, Twin2->Origin);
             v3 E2 = Q2 - P2;
 
             v3 Axis = Cross(E1, E2);
@@ -182,9 +183,9 @@ edge_query SATQueryEdges(hull *A, transform TA, hull *B, transform TB)
 
             // Transform the axis into A's local space so we can find the support.
             v3 AxisA = DirectionToLocalSpaceOfB(Axis, TB, TA);
-            v3 VertexA = PointToLocalSpaceOfB(HullSupport(A, AxisA), TA, TB);
+            v3 VertexA = PointToLocalSpaceOfB(HullSupport(A, ScaleA, AxisA), TA, TB);
 
-            v3 VertexB = HullSupport(B, -Axis);
+            v3 VertexB = HullSupport(B, ScaleB, -Axis);
             float Separation = Dot(Axis, VertexB - VertexA);
 
             if (Separation > Result.Separation)
@@ -200,18 +201,18 @@ edge_query SATQueryEdges(hull *A, transform TA, hull *B, transform TB)
     return Result;
 }
 
-void BuildFaceContact(face_query FaceQuery, hull *HullA, transform TA,
-                      hull *HullB, transform TB, contact_manifold *Manifold)
+void BuildFaceContact(face_query FaceQuery, hull *HullA, v3 ScaleA, transform TA,
+                      hull *HullB, v3 ScaleB, transform TB, contact_manifold *Manifold)
 {
     Manifold->Normal = FaceQuery.Normal;
 
     i32 IncidentFace = -1;
     float MinProj = FLT_MAX;
-    plane ReferenceFacePlane = HullA->Planes[FaceQuery.Index];
+    plane ReferenceFacePlane = ScaledPlane(HullA, ScaleA, FaceQuery.Index);
     v3 ReferenceNormal = DirectionToLocalSpaceOfB(ReferenceFacePlane.Normal, TA, TB);
     for (i32 i = 0; i < HullB->FaceCount; ++i)
     {
-        v3 Normal = HullB->Planes[i].Normal;
+        v3 Normal = ScaledPlane(HullB, ScaleB, i).Normal;
         float Proj = Dot(Normal, ReferenceNormal);
         if (Proj < MinProj)
         {
@@ -240,7 +241,8 @@ void BuildFaceContact(face_query FaceQuery, hull *HullA, transform TA,
     for (i32 i = 0; i < FaceEdgeCount; ++i)
     {
         // Move every vertex to the local space of A so we dont have to transform the clip planes.
-        Polygon.Vertices[i] = { PointToLocalSpaceOfB(HullB->Vertices[Edge->Origin], TB, TA), FaceQuery.Index };
+        // Unclipped vertices are keyed by their index, below zero to keep them apart from clipped ones.
+        Polygon.Vertices[i] = { PointToLocalSpaceOfB(ScaledVertex(HullB, ScaleB, Edge->Origin), TB, TA), -1 - Edge->Origin };
         Edge = HullB->Edges + Edge->Next;
     }
 
@@ -250,15 +252,25 @@ void BuildFaceContact(face_query FaceQuery, hull *HullA, transform TA,
     do
     {
         i32 ClipFace = HullA->Edges[Edge->Twin].Face;
-        Polygon = ClipPolygonBack(Polygon, HullA->Planes[ClipFace], ClipFace);
+        plane ClipPlane = ScaledPlane(HullA, ScaleA, ClipFace);
+        if (Dot(ClipPlane.Normal, ReferenceFacePlane.Normal) < -0.999f)
+        {
+            // Flat hulls like mesh triangles have the back face on the other side of every
+            // edge, clip against the plane through the edge perpendicular to the face instead.
+            v3 EdgeStart = ScaledVertex(HullA, ScaleA, Edge->Origin);
+            v3 EdgeEnd = ScaledVertex(HullA, ScaleA, HullA->Edges[Edge->Next].Origin);
+            ClipPlane = PlaneFromVectorAndPoint(Cross(EdgeEnd - EdgeStart, ReferenceFacePlane.Normal), EdgeStart);
+            ClipFace = HullA->FaceCount + CurrentEdge;
+        }
+        Polygon = ClipPolygonBack(Polygon, ClipPlane, ClipFace);
         CurrentEdge = Edge->Next;
         Edge = HullA->Edges + CurrentEdge;
     }
     while (CurrentEdge != StartEdge);
 
     // Pick a direction for contact point reduction.
-    v3 EdgeA = HullA->Vertices[Edge->Origin];
-    v3 EdgeB = HullA->Vertices[HullA->Edges[Edge->Next].Origin];
+    v3 EdgeA = ScaledVertex(HullA, ScaleA, Edge->Origin);
+    v3 EdgeB = ScaledVertex(HullA, ScaleA, HullA->Edges[Edge->Next].Origin);
     v3 Direction = EdgeB - EdgeA;
 
     i32 PointCount = 0;
@@ -385,8 +397,8 @@ void BuildFaceContact(face_query FaceQuery, hull *HullA, transform TA,
         for (i32 i = 0; i < PointCount; ++i)
         {
             contact_point *Point = Manifold->Points + i;
+            *Point = Points[i];
             Point->Position = PointToWorldSpace(Points[i].Position, TA);
-            Point->Penetration = Points[i].Penetration;
         }
     }
 }
@@ -458,7 +470,8 @@ void ClosestPointsSegmentSegment(v3 P1, v3 Q1, v3 P2, v3 Q2,
     *C2 = P2 + E2 * t;
 }
 
-void BuildEdgeContact(edge_query EdgeQuery, hull *A, transform  TA, hull *B, transform TB, contact_manifold *Manifold)
+void BuildEdgeContact(edge_query EdgeQuery, hull *A, v3 ScaleA, transform  TA,
+                      hull *B, v3 ScaleB, transform TB, contact_manifold *Manifold)
 {
     half_edge *EdgeA = A->Edges + EdgeQuery.EdgeA;
     half_edge *EdgeANext = A->Edges + EdgeA->Next;
@@ -466,11 +479,11 @@ void BuildEdgeContact(edge_query EdgeQuery, hull *A, transform  TA, hull *B, tra
     half_edge *EdgeB = B->Edges + EdgeQuery.EdgeB;
     half_edge *EdgeBNext = B->Edges + EdgeB->Next;
 
-    v3 P1 = PointToLocalSpaceOfB(A->Vertices[EdgeA->Origin], TA, TB);
-    v3 Q1 = PointToLocalSpaceOfB(A->Vertices[EdgeANext->Origin], TA, TB);
+    v3 P1 = PointToLocalSpaceOfB(ScaledVertex(A, ScaleA, EdgeA->Origin), TA, TB);
+    v3 Q1 = PointToLocalSpaceOfB(ScaledVertex(A, ScaleA, EdgeANext->Origin), TA, TB);
 
-    v3 P2 = B->Vertices[EdgeB->Origin];
-    v3 Q2 = B->Vertices[EdgeBNext->Origin];
+    v3 P2 = ScaledVertex(B, ScaleB, EdgeB->Origin);
+    v3 Q2 = ScaledVertex(B, ScaleB, EdgeBNext->Origin);
 
     v3 C1, C2;
     ClosestPointsSegmentSegment(P1, Q1, P2, Q2, &C1, &C2);
@@ -487,23 +500,23 @@ void BuildEdgeContact(edge_query EdgeQuery, hull *A, transform  TA, hull *B, tra
     Manifold->Normal = EdgeQuery.Normal;
 }
 
-bool CollideHulls(hull *A, transform TA, hull *B, transform TB, contact_manifold *Manifold)
+bool CollideHulls(hull *A, v3 ScaleA, transform TA, hull *B, v3 ScaleB, transform TB, contact_manifold *Manifold)
 {
     memset(Manifold, 0, sizeof(*Manifold));
 
-    face_query FaceQueryA = SATQueryFaces(A, TA, B, TB);
+    face_query FaceQueryA = SATQueryFaces(A, ScaleA, TA, B, ScaleB, TB);
     if (FaceQueryA.Separation > 0.0f)
     {
         return false;
     }
 
-    face_query FaceQueryB = SATQueryFaces(B, TB, A, TA);
+    face_query FaceQueryB = SATQueryFaces(B, ScaleB, TB, A, ScaleA, TA);
     if (FaceQueryB.Separation > 0.0f)
     {
         return false;
     }
 
-    edge_query EdgeQuery = SATQueryEdges(A, TA, B, TB);
+    edge_query EdgeQuery = SATQueryEdges(A, ScaleA, TA, B, ScaleB, TB);
     if (EdgeQuery.Separation > 0.0f)
     {
         return false;
@@ -516,15 +529,17 @@ bool CollideHulls(hull *A, transform TA, hull *B, transform TB, contact_manifold
         FaceQueryB.Separation < (EdgeQuery.Separation - Bias);
     if (IsEdgeContact)
     {
-        BuildEdgeContact(EdgeQuery, A, TA, B, TB, Manifold);
+        BuildEdgeContact(EdgeQuery, A, ScaleA, TA, B, ScaleB, TB, Manifold);
     }
-    else if (FaceQueryA.Separation > FaceQueryB.Separation)
+    // Prefer A when both faces are about as deep, so the reference face and with it the
+    // contact IDs don't flip between frames for resting pairs.
+    else if (FaceQueryA.Separation + 0.05f >= FaceQueryB.Separation)
     {
-        BuildFaceContact(FaceQueryA, A, TA, B, TB, Manifold);
+        BuildFaceContact(FaceQueryA, A, ScaleA, TA, B, ScaleB, TB, Manifold);
     }
     else
     {
-        BuildFaceContact(FaceQueryB, B, TB, A, TA, Manifold);
+        BuildFaceContact(FaceQueryB, B, ScaleB, TB, A, ScaleA, TA, Manifold);
         // Negate such that the normal consistently points towards B.
         Manifold->Normal = -Manifold->Normal;
     }
@@ -541,10 +556,13 @@ bool CollideSpheres(sphere a, sphere b, contact_manifold *Manifold)
     if (PenetrationDepth <= 0)
     {
         Result = true;
-        v3 Normal = Diff / Distance;
+        // Concentric spheres have no meaningful normal, just pick one.
+        v3 Normal = Distance > ML_EPSILON ? Diff / Distance : V3(0,0,1);
         Manifold->PointCount = 1;
         Manifold->Points[0].Position = a.Center + Normal *  (a.Radius - fabs(PenetrationDepth)/2.f);
         Manifold->Points[0].Penetration = PenetrationDepth;
+        Manifold->Points[0].ID.Type = ContactType_Face;
+        Manifold->Points[0].ID.Value = 0;
         Manifold->Normal = Normal;
     }
     return Result;
@@ -591,3 +609,360 @@ bool CollideSphereAABB(sphere Sphere, aabb Box, contact_manifold *Manifold)
 
 
 
+
+v3 ClosestPointSegment(v3 Point, v3 P, v3 Q)
+{
+    v3 PQ = Q - P;
+    float LengthSq = Dot(PQ, PQ);
+    if (LengthSq <= ML_EPSILON)
+    {
+        return P;
+    }
+    float t = Clamp(Dot(Point - P, PQ) / LengthSq, 0.f, 1.f);
+    return P + PQ * t;
+}
+
+bool CollideSphereCapsule(sphere Sphere, capsule Capsule, contact_manifold *Manifold)
+{
+    sphere Closest;
+    Closest.Center = ClosestPointSegment(Sphere.Center, Capsule.P, Capsule.Q);
+    Closest.Radius = Capsule.Radius;
+    return CollideSpheres(Sphere, Closest, Manifold);
+}
+
+bool CollideCapsules(capsule A, capsule B, contact_manifold *Manifold)
+{
+    sphere SphereA, SphereB;
+    ClosestPointsSegmentSegment(A.P, A.Q, B.P, B.Q, &SphereA.Center, &SphereB.Center);
+    SphereA.Radius = A.Radius;
+    SphereB.Radius = B.Radius;
+    return CollideSpheres(SphereA, SphereB, Manifold);
+}
+
+// Closest point on a (convex) hull face to a point that lies in front of the face.
+v3 ClosestPointHullFace(hull *Hull, v3 Scale, i32 FaceIndex, v3 Point)
+{
+    plane Plane = ScaledPlane(Hull, Scale, FaceIndex);
+    v3 Projected = ProjectPointOnPlane(Plane, Point);
+
+    bool Inside = true;
+    float MinDistanceSq = FLT_MAX;
+    v3 Result = Projected;
+
+    i32 StartEdge = Hull->Faces[FaceIndex].Edge;
+    i32 CurrentEdge = StartEdge;
+    do
+    {
+        half_edge *Edge = Hull->Edges + CurrentEdge;
+        v3 P = ScaledVertex(Hull, Scale, Edge->Origin);
+        v3 Q = ScaledVertex(Hull, Scale, Hull->Edges[Edge->Next].Origin);
+        if (Dot(Cross(Q - P, Projected - P), Plane.Normal) < 0.f)
+        {
+            Inside = false;
+        }
+
+        v3 Closest = ClosestPointSegment(Projected, P, Q);
+        float DistanceSq = LengthSquared(Closest - Projected);
+        if (DistanceSq < MinDistanceSq)
+        {
+            MinDistanceSq = DistanceSq;
+            Result = Closest;
+        }
+        CurrentEdge = Edge->Next;
+    }
+    while (CurrentEdge != StartEdge);
+
+    if (Inside)
+    {
+        Result = Projected;
+    }
+    return Result;
+}
+
+// The sphere is in world space, the normal points from the sphere towards the hull.
+bool CollideSphereHull(sphere Sphere, hull *Hull, v3 Scale, transform T, contact_manifold *Manifold)
+{
+    memset(Manifold, 0, sizeof(*Manifold));
+
+    v3 Center = PointToLocalSpace(Sphere.Center, T);
+
+    i32 BestFace = -1;
+    float MaxSeparation = -FLT_MAX;
+    for (i32 i = 0; i < Hull->FaceCount; ++i)
+    {
+        float Separation = SignedDistance(ScaledPlane(Hull, Scale, i), Center);
+        if (Separation > Sphere.Radius)
+        {
+            return false;
+        }
+
+        if (Separation > MaxSeparation)
+        {
+            MaxSeparation = Separation;
+            BestFace = i;
+        }
+    }
+
+    v3 Normal;
+    v3 Position;
+    float Penetration;
+    if (MaxSeparation <= 0.f)
+    {
+        // Deep contact, the center is inside the hull so push out along the closest face.
+        plane Plane = ScaledPlane(Hull, Scale, BestFace);
+        Normal = -Plane.Normal;
+        Position = ProjectPointOnPlane(Plane, Center);
+        Penetration = MaxSeparation - Sphere.Radius;
+    }
+    else
+    {
+        // The closest point on the hull lies on one of the faces the center is in front of.
+        float MinDistanceSq = FLT_MAX;
+        for (i32 i = 0; i < Hull->FaceCount; ++i)
+        {
+            if (SignedDistance(ScaledPlane(Hull, Scale, i), Center) <= 0.f)
+            {
+                continue;
+            }
+
+            v3 Closest = ClosestPointHullFace(Hull, Scale, i, Center);
+            float DistanceSq = LengthSquared(Closest - Center);
+            if (DistanceSq < MinDistanceSq)
+            {
+                MinDistanceSq = DistanceSq;
+                Position = Closest;
+            }
+        }
+
+        float Distance = sqrtf(MinDistanceSq);
+        if (Distance > Sphere.Radius)
+        {
+            return false;
+        }
+
+        // The center can end up right on the surface, then the direction is undefined.
+        if (Distance > ML_EPSILON)
+        {
+            Normal = (Position - Center) / Distance;
+        }
+        else
+        {
+            Normal = -ScaledPlane(Hull, Scale, BestFace).Normal;
+        }
+        Penetration = Distance - Sphere.Radius;
+    }
+
+    Manifold->PointCount = 1;
+    Manifold->Normal = RotateVector(Normal, T.Rotation);
+    Manifold->Points[0].Position = PointToWorldSpace(Position, T);
+    Manifold->Points[0].Penetration = Penetration;
+    Manifold->Points[0].ID.Type = ContactType_Face;
+    Manifold->Points[0].ID.FaceA = 0;
+    Manifold->Points[0].ID.FaceB = BestFace;
+    return true;
+}
+
+// The capsule is in world space, the normal points from the capsule towards the hull.
+// Like CollideHulls this is a SAT test, using the hull faces and the cross products of
+// the capsule segment with the hull edges as axes.
+bool CollideCapsuleHull(capsule Capsule, hull *Hull, v3 Scale, transform T, contact_manifold *Manifold)
+{
+    memset(Manifold, 0, sizeof(*Manifold));
+
+    v3 P = PointToLocalSpace(Capsule.P, T);
+    v3 Q = PointToLocalSpace(Capsule.Q, T);
+    v3 Segment = Q - P;
+
+    face_query FaceQuery;
+    FaceQuery.Index = -1;
+    FaceQuery.Separation = -FLT_MAX;
+    for (i32 i = 0; i < Hull->FaceCount; ++i)
+    {
+        plane Plane = ScaledPlane(Hull, Scale, i);
+        float Separation = Min(SignedDistance(Plane, P), SignedDistance(Plane, Q)) - Capsule.Radius;
+        if (Separation > FaceQuery.Separation)
+        {
+            FaceQuery.Index = i;
+            FaceQuery.Normal = Plane.Normal;
+            FaceQuery.Separation = Separation;
+        }
+    }
+
+    if (FaceQuery.Separation > 0.f)
+    {
+        return false;
+    }
+
+    edge_query EdgeQuery;
+    EdgeQuery.EdgeA = -1;
+    EdgeQuery.Separation = -FLT_MAX;
+    for (i32 Index = 0; Index < Hull->EdgeCount; Index += 2)
+    {
+        v3 EdgeP = ScaledVertex(Hull, Scale, Hull->Edges[Index].Origin);
+        v3 EdgeQ = ScaledVertex(Hull, Scale, Hull->Edges[Index+1].Origin);
+
+        v3 Axis = Cross(Segment, EdgeQ - EdgeP);
+        if (IsZeroVector(Axis))
+        {
+            continue;
+        }
+
+        // Make the axis point away from the hull.
+        if (Dot(Axis, EdgeP - Hadamard(Hull->Centroid, Scale)) < 0.f)
+        {
+            Axis = -Axis;
+        }
+        Axis = Normalized(Axis);
+
+        float HullMax = Dot(Axis, HullSupport(Hull, Scale, Axis));
+        float Separation = Min(Dot(Axis, P), Dot(Axis, Q)) - HullMax - Capsule.Radius;
+        if (Separation > EdgeQuery.Separation)
+        {
+            EdgeQuery.EdgeA = Index;
+            EdgeQuery.Normal = Axis;
+            EdgeQuery.Separation = Separation;
+        }
+    }
+
+    if (EdgeQuery.Separation > 0.f)
+    {
+        return false;
+    }
+
+    // Bias to prefer building face contacts.
+    float Bias = 1.f;
+    if (EdgeQuery.EdgeA != -1 && FaceQuery.Separation < (EdgeQuery.Separation - Bias))
+    {
+        v3 EdgeP = ScaledVertex(Hull, Scale, Hull->Edges[EdgeQuery.EdgeA].Origin);
+        v3 EdgeQ = ScaledVertex(Hull, Scale, Hull->Edges[EdgeQuery.EdgeA+1].Origin);
+
+        v3 C1, C2;
+        ClosestPointsSegmentSegment(P, Q, EdgeP, EdgeQ, &C1, &C2);
+
+        Manifold->PointCount = 1;
+        Manifold->Normal = RotateVector(-EdgeQuery.Normal, T.Rotation);
+        Manifold->Points[0].Position = PointToWorldSpace(C2, T);
+        Manifold->Points[0].Penetration = EdgeQuery.Separation;
+        Manifold->Points[0].ID.Type = ContactType_Edge;
+        Manifold->Points[0].ID.EdgeA = 0;
+        Manifold->Points[0].ID.EdgeB = EdgeQuery.EdgeA;
+        return true;
+    }
+
+    // Clip the segment against the side planes of the reference face.
+    plane ReferencePlane = ScaledPlane(Hull, Scale, FaceQuery.Index);
+    v3 ClipP = P;
+    v3 ClipQ = Q;
+    bool Clipped = false;
+
+    i32 StartEdge = Hull->Faces[FaceQuery.Index].Edge;
+    i32 CurrentEdge = StartEdge;
+    do
+    {
+        half_edge *Edge = Hull->Edges + CurrentEdge;
+        plane SidePlane = ScaledPlane(Hull, Scale, Hull->Edges[Edge->Twin].Face);
+        float DistanceP = SignedDistance(SidePlane, ClipP);
+        float DistanceQ = SignedDistance(SidePlane, ClipQ);
+        if (DistanceP > 0.f && DistanceQ > 0.f)
+        {
+            Clipped = true;
+            break;
+        }
+        else if (DistanceP > 0.f)
+        {
+            ClipP = ClipP + (ClipQ - ClipP) * (DistanceP / (DistanceP - DistanceQ));
+        }
+        else if (DistanceQ > 0.f)
+        {
+            ClipQ = ClipQ + (ClipP - ClipQ) * (DistanceQ / (DistanceQ - DistanceP));
+        }
+        CurrentEdge = Edge->Next;
+    }
+    while (CurrentEdge != StartEdge);
+
+    if (Clipped)
+    {
+        // The segment lies entirely outside a side plane, so outside the hull, and the
+        // distance to the reference plane says nothing about how close it is. The closest
+        // features are an end point and a face in front of it, or the segment and an edge.
+        float MinDistanceSq = FLT_MAX;
+        v3 SegmentPoint = P;
+        v3 HullPoint = P;
+        v3 Ends[2] = { P, Q };
+        for (i32 k = 0; k < 2; ++k)
+        {
+            for (i32 i = 0; i < Hull->FaceCount; ++i)
+            {
+                if (SignedDistance(ScaledPlane(Hull, Scale, i), Ends[k]) <= 0.f)
+                {
+                    continue;
+                }
+
+                v3 Closest = ClosestPointHullFace(Hull, Scale, i, Ends[k]);
+                float DistanceSq = LengthSquared(Closest - Ends[k]);
+                if (DistanceSq < MinDistanceSq)
+                {
+                    MinDistanceSq = DistanceSq;
+                    SegmentPoint = Ends[k];
+                    HullPoint = Closest;
+                }
+            }
+        }
+
+        for (i32 Index = 0; Index < Hull->EdgeCount; Index += 2)
+        {
+            v3 EdgeP = ScaledVertex(Hull, Scale, Hull->Edges[Index].Origin);
+            v3 EdgeQ = ScaledVertex(Hull, Scale, Hull->Edges[Index+1].Origin);
+
+            v3 C1, C2;
+            ClosestPointsSegmentSegment(P, Q, EdgeP, EdgeQ, &C1, &C2);
+            float DistanceSq = LengthSquared(C2 - C1);
+            if (DistanceSq < MinDistanceSq)
+            {
+                MinDistanceSq = DistanceSq;
+                SegmentPoint = C1;
+                HullPoint = C2;
+            }
+        }
+
+        float Distance = sqrtf(MinDistanceSq);
+        if (Distance > Capsule.Radius)
+        {
+            return false;
+        }
+
+        v3 Normal = Distance > ML_EPSILON ? (HullPoint - SegmentPoint) / Distance : -ReferencePlane.Normal;
+        Manifold->PointCount = 1;
+        Manifold->Normal = RotateVector(Normal, T.Rotation);
+        Manifold->Points[0].Position = PointToWorldSpace(HullPoint, T);
+        Manifold->Points[0].Penetration = Distance - Capsule.Radius;
+        Manifold->Points[0].ID.Type = ContactType_Face;
+        Manifold->Points[0].ID.FaceA = 0;
+        Manifold->Points[0].ID.FaceB = FaceQuery.Index;
+        return true;
+    }
+
+    v3 Points[2] = { ClipP, ClipQ };
+    i32 PointCount = IsZeroVector(ClipQ - ClipP) ? 1 : 2;
+    for (i32 i = 0; i < PointCount; ++i)
+    {
+        float Separation = SignedDistance(ReferencePlane, Points[i]) - Capsule.Radius;
+        if (Separation <= 0.f)
+        {
+            contact_point *Contact = Manifold->Points + Manifold->PointCount++;
+            Contact->Position = PointToWorldSpace(ProjectPointOnPlane(ReferencePlane, Points[i]), T);
+            Contact->Penetration = Separation;
+            Contact->ID.Type = ContactType_Face;
+            Contact->ID.FaceA = i;
+            Contact->ID.FaceB = FaceQuery.Index;
+        }
+    }
+
+    if (Manifold->PointCount == 0)
+    {
+        return false;
+    }
+
+    Manifold->Normal = RotateVector(-ReferencePlane.Normal, T.Rotation);
+    return true;
+}
@@ -27,6 +27,14 @@ struct sphere
     float Radius;
 };
 
+// Swept sphere around the segment PQ.
+struct capsule
+{
+    v3 P;
+    v3 Q;
+    float Radius;
+};
+
 struct half_edge
 {
     u16 Next;
@@ -52,9 +60,117 @@ struct hull
     plane *Planes;
 };
 
+// Hulls are shared between bodies of different sizes, the per body scale is applied
+// whenever a vertex or plane is read.
+inline v3 ScaledVertex(hull *Hull, v3 Scale, i32 Index)
+{
+    return Hadamard(Hull->Vertices[Index], Scale);
+}
+
+inline plane ScaledPlane(hull *Hull, v3 Scale, i32 Index)
+{
+    // Normals transform with the inverse scale.
+    plane Plane = Hull->Planes[Index];
+    v3 Normal = V3(Plane.Normal.x / Scale.x, Plane.Normal.y / Scale.y, Plane.Normal.z / Scale.z);
+    float InverseLength = 1.f / Length(Normal);
+    Plane.Normal = Normal * InverseLength;
+    Plane.Distance *= InverseLength;
+    return Plane;
+}
+
+struct compound_child
+{
+    hull *Hull;
+    v3 Scale;
+    // Relative to the compound.
+    transform Transform;
+    aabb Bounds;
+};
+
+// Nodes are stored depth first, so the left child of an internal node is the next node.
+struct compound_node
+{
+    aabb Bounds;
+    i32 RightNode;
+    // -1 for internal nodes.
+    i32 Child;
+};
+
+struct compound
+{
+    i32 ChildCount;
+    compound_child *Children;
+    i32 NodeCount;
+    compound_node *Nodes;
+};
+
+// Node bounds are quantized to 16 bits relative to the mesh bounds, rounded outwards.
+// Internal nodes have their left child right after them.
+struct triangle_mesh_node
+{
+    u16 QuantizedMin[3];
+    u16 QuantizedMax[3];
+    // 0 for internal nodes.
+    u16 TriangleCount;
+    u16 Padding;
+    // Right child for internal nodes, first triangle for leaves.
+    i32 Index;
+};
+
+// Set for edges that are on the boundary of the mesh or convex, contacts on the other
+// edges are internal and get the normal of the triangle.
+enum
+{
+    TriangleEdge_Active0 = 1 << 0,
+    TriangleEdge_Active1 = 1 << 1,
+    TriangleEdge_Active2 = 1 << 2,
+};
+
+// Static only, triangles are reordered to match the leaves of the tree.
+struct triangle_mesh
+{
+    i32 VertexCount;
+    v3 *Vertices;
+    i32 TriangleCount;
+    u32 *Indices;
+    u8 *EdgeFlags;
+
+    aabb Bounds;
+    v3 QuantizationScale;
+    i32 NodeCount;
+    triangle_mesh_node *Nodes;
+};
+
+// Min and max of the quantized heights, level 0 has one entry per cell and every level
+// above halves the resolution.
+struct heightfield_mip
+{
+    i32 CellsX;
+    i32 CellsY;
+    u16 *MinHeights;
+    u16 *MaxHeights;
+};
+
+// Samples lie on a regular grid in the xy plane of the body, heights along z.
+struct heightfield
+{
+    i32 SamplesX;
+    i32 SamplesY;
+    float CellSize;
+    float MinHeight;
+    float HeightScale;
+    u16 *Heights;
+
+    i32 MipCount;
+    heightfield_mip *Mips;
+    aabb Bounds;
+};
+
 struct polygon_vertex
 {
     v3 Position;
+    // Feature the vertex came from, used for contact IDs. Vertices made by clipping
+    // against a face get twice its index, plus one where the polygon enters the face.
     i32 FaceIndex;
 };
 
@@ -138,6 +254,46 @@ inline transform TransformCombine(transform A, transform B)
     return Result;
 }
 
+// Child is relative to Parent.
+inline transform TransformConcat(transform Parent, transform Child)
+{
+    transform Result;
+    Result.Position = Parent.Position + RotateVector(Child.Position, Parent.Rotation);
+    Result.Rotation = Parent.Rotation * Child.Rotation;
+    return Result;
+}
+
+// Returns B relative to A.
+inline transform RelativeTransform(transform A, transform B)
+{
+    transform Result;
+    quaternion InverseRotationA = Inverse(A.Rotation);
+    Result.Position = RotateVector(B.Position - A.Position, InverseRotationA);
+    Result.Rotation = InverseRotationA * B.Rotation;
+    return Result;
+}
+
+inline aabb TransformAABB(aabb A, transform T)
+{
+    m3x3 R = RotationMatrix3(T.Rotation);
+    v3 Center = (A.Min + A.Max) * 0.5f;
+    v3 Extents = (A.Max - A.Min) * 0.5f;
+    v3 NewCenter = R * Center + T.Position;
+    v3 NewExtents;
+    for (i32 i = 0; i < 3; ++i)
+    {
+        NewExtents[i] =
+            fabsf(R[i][0]) * Extents.x +
+            fabsf(R[i][1]) * Extents.y +
+            fabsf(R[i][2]) * Extents.z;
+    }
+
+    aabb Result;
+    Result.Min = NewCenter - NewExtents;
+    Result.Max = NewCenter + NewExtents;
+    return Result;
+}
+
 bool IntersectAABBAABB(aabb A, aabb B)
 {
     if (A.Max[0] < B.Min[0] || A.Min[0] > B.Max[0]) return false;
@@ -161,7 +317,8 @@ bool InsideAABBAABB(aabb A, aabb B)
     }
 }
 
-// @TODO: This should be replaced with a quickhull implementation eventually.
+// Boxes are laid out by hand since their topology is fixed, other point sets go through
+// QuickHull.
 inline hull* DEBUGCreateBoxHull(arena *Arena, v3 Min, v3 Max)
 {
     hull *Result = ArenaPushType(Arena, hull);
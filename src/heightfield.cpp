@@ -0,0 +1,249 @@
+//
+// Heightfields for terrain. Heights are quantized to 16 bits between the lowest and the
+// highest sample, and the min/max mips let queries skip whole regions the body is above.
+//
+
+inline float GetHeight(heightfield *Field, i32 x, i32 y)
+{
+    return Field->MinHeight + Field->Heights[y * Field->SamplesX + x] * Field->HeightScale;
+}
+
+inline v3 GetHeightfieldPoint(heightfield *Field, i32 x, i32 y)
+{
+    return V3(x * Field->CellSize, y * Field->CellSize, GetHeight(Field, x, y));
+}
+
+// Cells are split along the diagonal from (x, y) to (x+1, y+1). Returns the active edge
+// flags of the triangle, edges on the border of the field are always active.
+u8 GetHeightfieldTriangle(heightfield *Field, i32 Cell, i32 Half, v3 *Vertices)
+{
+    i32 CellsX = Field->SamplesX - 1;
+    i32 CellsY = Field->SamplesY - 1;
+    i32 x = Cell % CellsX;
+    i32 y = Cell / CellsX;
+
+    v3 P00 = GetHeightfieldPoint(Field, x, y);
+    v3 P10 = GetHeightfieldPoint(Field, x + 1, y);
+    v3 P01 = GetHeightfieldPoint(Field, x, y + 1);
+    v3 P11 = GetHeightfieldPoint(Field, x + 1, y + 1);
+
+    // For every edge the vertex opposite to it in the neighbouring triangle.
+    v3 Neighbours[3];
+    bool HasNeighbour[3];
+    if (Half == 0)
+    {
+        Vertices[0] = P00;
+        Vertices[1] = P10;
+        Vertices[2] = P11;
+        HasNeighbour[0] = y > 0;
+        HasNeighbour[1] = x + 1 < CellsX;
+        HasNeighbour[2] = true;
+        if (HasNeighbour[0]) Neighbours[0] = GetHeightfieldPoint(Field, x, y - 1);
+        if (HasNeighbour[1]) Neighbours[1] = GetHeightfieldPoint(Field, x + 2, y + 1);
+        Neighbours[2] = P01;
+    }
+    else
+    {
+        Vertices[0] = P00;
+        Vertices[1] = P11;
+        Vertices[2] = P01;
+        HasNeighbour[0] = true;
+        HasNeighbour[1] = y + 1 < CellsY;
+        HasNeighbour[2] = x > 0;
+        Neighbours[0] = P10;
+        if (HasNeighbour[1]) Neighbours[1] = GetHeightfieldPoint(Field, x + 1, y + 2);
+        if (HasNeighbour[2]) Neighbours[2] = GetHeightfieldPoint(Field, x - 1, y);
+    }
+
+    u8 Result = 0;
+    v3 Normal = Cross(Vertices[1] - Vertices[0], Vertices[2] - Vertices[0]);
+    if (IsZeroVector(Normal))
+    {
+        return Result;
+    }
+    Normal = Normalized(Normal);
+
+    for (i32 k = 0; k < 3; ++k)
+    {
+        if (!HasNeighbour[k] || IsActiveEdge(Normal, Vertices[k], Vertices[(k + 1) % 3], Neighbours[k]))
+        {
+            Result |= (u8)(1 << k);
+        }
+    }
+    return Result;
+}
+
+// Heights are given row by row, SamplesX per row.
+heightfield *BuildHeightfield(arena *Arena, float *Heights, i32 SamplesX, i32 SamplesY, float CellSize)
+{
+    ASSERT(SamplesX >= 2 && SamplesY >= 2);
+
+    heightfield *Field = ArenaPushType(Arena, heightfield);
+    Field->SamplesX = SamplesX;
+    Field->SamplesY = SamplesY;
+    Field->CellSize = CellSize;
+
+    i32 SampleCount = SamplesX * SamplesY;
+    float MinHeight = FLT_MAX;
+    float MaxHeight = -FLT_MAX;
+    for (i32 i = 0; i < SampleCount; ++i)
+    {
+        MinHeight = Min(MinHeight, Heights[i]);
+        MaxHeight = Max(MaxHeight, Heights[i]);
+    }
+    Field->MinHeight = MinHeight;
+    Field->HeightScale = Max(MaxHeight - MinHeight, ML_EPSILON) / 65535.f;
+
+    Field->Heights = ArenaPushArray(Arena, SampleCount, u16);
+    for (i32 i = 0; i < SampleCount; ++i)
+    {
+        float Quantized = (Heights[i] - MinHeight) / Field->HeightScale + 0.5f;
+        Field->Heights[i] = (u16)Clamp(Quantized, 0.f, 65535.f);
+    }
+
+    Field->Bounds.Min = V3(0, 0, MinHeight);
+    Field->Bounds.Max = V3((SamplesX - 1) * CellSize, (SamplesY - 1) * CellSize, MaxHeight);
+
+    i32 MipCount = 1;
+    for (i32 CellsX = SamplesX - 1, CellsY = SamplesY - 1;
+         CellsX > 1 || CellsY > 1;
+         CellsX = (CellsX + 1) / 2, CellsY = (CellsY + 1) / 2)
+    {
+        MipCount++;
+    }
+    Field->MipCount = MipCount;
+    Field->Mips = ArenaPushArray(Arena, MipCount, heightfield_mip);
+
+    heightfield_mip *Base = Field->Mips;
+    Base->CellsX = SamplesX - 1;
+    Base->CellsY = SamplesY - 1;
+    Base->MinHeights = ArenaPushArray(Arena, Base->CellsX * Base->CellsY, u16);
+    Base->MaxHeights = ArenaPushArray(Arena, Base->CellsX * Base->CellsY, u16);
+    for (i32 y = 0; y < Base->CellsY; ++y)
+    {
+        for (i32 x = 0; x < Base->CellsX; ++x)
+        {
+            u16 *Row0 = Field->Heights + y * SamplesX + x;
+            u16 *Row1 = Row0 + SamplesX;
+            u16 Lo = Row0[0];
+            u16 Hi = Row0[0];
+            u16 Corners[] = {Row0[1], Row1[0], Row1[1]};
+            for (i32 i = 0; i < ARRAY_SIZE(Corners); ++i)
+            {
+                Lo = Corners[i] < Lo ? Corners[i] : Lo;
+                Hi = Corners[i] > Hi ? Corners[i] : Hi;
+            }
+            Base->MinHeights[y * Base->CellsX + x] = Lo;
+            Base->MaxHeights[y * Base->CellsX + x] = Hi;
+        }
+    }
+
+    for (i32 Level = 1; Level < MipCount; ++Level)
+    {
+        heightfield_mip *Child = Field->Mips + Level - 1;
+        heightfield_mip *Mip = Field->Mips + Level;
+        Mip->CellsX = (Child->CellsX + 1) / 2;
+        Mip->CellsY = (Child->CellsY + 1) / 2;
+        Mip->MinHeights = ArenaPushArray(Arena, Mip->CellsX * Mip->CellsY, u16);
+        Mip->MaxHeights = ArenaPushArray(Arena, Mip->CellsX * Mip->CellsY, u16);
+        for (i32 y = 0; y < Mip->CellsY; ++y)
+        {
+            for (i32 x = 0; x < Mip->CellsX; ++x)
+            {
+                u16 Lo = 0xFFFF;
+                u16 Hi = 0;
+                i32 EndX = (2*x + 2 < Child->CellsX) ? 2*x + 2 : Child->CellsX;
+                i32 EndY = (2*y + 2 < Child->CellsY) ? 2*y + 2 : Child->CellsY;
+                for (i32 cy = 2*y; cy < EndY; ++cy)
+                {
+                    for (i32 cx = 2*x; cx < EndX; ++cx)
+                    {
+                        i32 Index = cy * Child->CellsX + cx;
+                        Lo = Child->MinHeights[Index] < Lo ? Child->MinHeights[Index] : Lo;
+                        Hi = Child->MaxHeights[Index] > Hi ? Child->MaxHeights[Index] : Hi;
+                    }
+                }
+                Mip->MinHeights[y * Mip->CellsX + x] = Lo;
+                Mip->MaxHeights[y * Mip->CellsX + x] = Hi;
+            }
+        }
+    }
+
+    return Field;
+}
+
+// Bounds are in the local space of the heightfield. Finds the cells under them that reach
+// up to the bottom of the bounds, returns how many there are and writes the indices of
+// the first MaxCells.
+i32 QueryHeightfield(heightfield *Field, aabb Bounds, i32 *Cells, i32 MaxCells)
+{
+    if (!IntersectAABBAABB(Field->Bounds, Bounds))
+    {
+        return 0;
+    }
+
+    heightfield_mip *Base = Field->Mips;
+    float InverseCellSize = 1.f / Field->CellSize;
+    i32 MinX = (i32)Clamp(floorf(Bounds.Min.x * InverseCellSize), 0.f, (float)(Base->CellsX - 1));
+    i32 MinY = (i32)Clamp(floorf(Bounds.Min.y * InverseCellSize), 0.f, (float)(Base->CellsY - 1));
+    i32 MaxX = (i32)Clamp(floorf(Bounds.Max.x * InverseCellSize), 0.f, (float)(Base->CellsX - 1));
+    i32 MaxY = (i32)Clamp(floorf(Bounds.Max.y * InverseCellSize), 0.f, (float)(Base->CellsY - 1));
+
+    // Terrain is solid below the surface, so only regions entirely under the body are culled.
+    float Bottom = (Bounds.Min.z - Field->MinHeight) / Field->HeightScale;
+    u16 QueryBottom = (u16)Clamp(floorf(Bottom), 0.f, 65535.f);
+
+    i32 Count = 0;
+    i32 StackCount = 0;
+    i32 Stack[128][3];
+    Stack[StackCount][0] = Field->MipCount - 1;
+    Stack[StackCount][1] = 0;
+    Stack[StackCount][2] = 0;
+    StackCount++;
+    while (StackCount > 0)
+    {
+        --StackCount;
+        i32 Level = Stack[StackCount][0];
+        i32 x = Stack[StackCount][1];
+        i32 y = Stack[StackCount][2];
+
+        // Range of base cells covered by this mip cell.
+        if ((x << Level) > MaxX || (((x + 1) << Level) - 1) < MinX ||
+            (y << Level) > MaxY || (((y + 1) << Level) - 1) < MinY)
+        {
+            continue;
+        }
+
+        heightfield_mip *Mip = Field->Mips + Level;
+        if (Mip->MaxHeights[y * Mip->CellsX + x] < QueryBottom)
+        {
+            continue;
+        }
+
+        if (Level == 0)
+        {
+            if (Count < MaxCells)
+            {
+                Cells[Count] = y * Base->CellsX + x;
+            }
+            Count++;
+            continue;
+        }
+
+        heightfield_mip *Child = Field->Mips + Level - 1;
+        i32 EndX = (2*x + 2 < Child->CellsX) ? 2*x + 2 : Child->CellsX;
+        i32 EndY = (2*y + 2 < Child->CellsY) ? 2*y + 2 : Child->CellsY;
+        for (i32 cy = 2*y; cy < EndY; ++cy)
+        {
+            for (i32 cx = 2*x; cx < EndX; ++cx)
+            {
+                ASSERT(StackCount < ARRAY_SIZE(Stack));
+                Stack[StackCount][0] = Level - 1;
+                Stack[StackCount][1] = cx;
+                Stack[StackCount][2] = cy;
+                StackCount++;
+            }
+        }
+    }
+    return Count;
+}
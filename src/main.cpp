@@ -22,12 +22,89 @@ rigid_body *GetEntityByHandle(entity_handle Handle)
     return GetWorld()->Entities + Handle;
 }
 
+body_motion *GetBodyMotion(entity_handle Handle)
+{
+    ASSERT(Handle != 0);
+    return GetWorld()->Motions + Handle;
+}
+
+transform GetBodyPose(entity_handle Handle)
+{
+    ASSERT(Handle != 0);
+    return GetWorld()->Poses[Handle];
+}
+
+void SetBodyPose(entity_handle Handle, v3 Position, quaternion Orientation)
+{
+    ASSERT(Handle != 0);
+    world *World = GetWorld();
+    World->Poses[Handle].Position = Position;
+    World->Poses[Handle].Rotation = Orientation;
+    World->PoseChanged[Handle] = true;
+}
+
+// Does nothing but return the bounds if the body hasn't moved since the last call.
+aabb UpdateBodyBounds(entity_handle Handle)
+{
+    ASSERT(Handle != 0);
+    world *World = GetWorld();
+    if (World->PoseChanged[Handle])
+    {
+        World->WorldBounds[Handle] = TransformAABB(World->Entities[Handle].BoundingVolume, World->Poses[Handle]);
+        World->PoseChanged[Handle] = false;
+    }
+    return World->WorldBounds[Handle];
+}
+
+void rigid_body::Recalculate()
+{
+    world *World = GetWorld();
+    body_motion *Motion = World->Motions + (this - World->Entities);
+    transform *Pose = World->Poses + (this - World->Entities);
+    // Normalize first, an unnormalized rotation would scale the inertia and the
+    // momentum round trip through the solver would amplify it every step.
+    Pose->Rotation = Normalized(Pose->Rotation);
+    if (Type == RigidBodyType_Dynamic)
+    {
+        m3x3 R = RotationMatrix3(Pose->Rotation);
+        Motion->InverseMass = InverseMass;
+        Motion->WorldInverseInertia = R * InverseInertia * Transpose(R);
+    }
+    else
+    {
+        Motion->InverseMass = 0.f;
+        Motion->WorldInverseInertia = {};
+    }
+    Motion->LinearVelocity = Motion->InverseMass * LinearMomentum;
+    Motion->AngularVelocity = Motion->WorldInverseInertia * AngularMomentum;
+}
+
+// The solver works on the velocities directly, this brings the momentum back in sync.
+void rigid_body::RecalculateMomentum()
+{
+    world *World = GetWorld();
+    body_motion *Motion = World->Motions + (this - World->Entities);
+    LinearMomentum = Mass * Motion->LinearVelocity;
+    m3x3 R = RotationMatrix3(World->Poses[this - World->Entities].Rotation);
+    AngularMomentum = R * Inertia * Transpose(R) * Motion->AngularVelocity;
+}
+
+// Only wakes the body itself, the rest of its island follows in the next step.
+void WakeBody(entity_handle Handle)
+{
+    rigid_body *Body = GetEntityByHandle(Handle);
+    Body->IsSleeping = false;
+    Body->SleepTime = 0.f;
+}
+
 entity_handle CreateEntity(rigid_body **Out)
 {
     world *World = GetWorld();
     entity_handle EntityID = World->EntityCount++;
     rigid_body *Entity = World->Entities + EntityID;
     *Entity = {};
+    World->Motions[EntityID] = {};
+    World->RenderData[EntityID] = {};
     if (Out)
     {
         *Out = Entity;
@@ -45,53 +122,241 @@ void InitApp()
     State->PersistentArena = CreateArena();
 
     World->HullArena = CreateArena();
-    World->SolverIterations = 5;
+    World->HullCache.MaxEntries = 64;
+    World->HullCache.Entries = ArenaPushArray(PersistentArena(), World->HullCache.MaxEntries, hull_cache_entry);
+    World->SolverIterations = 20;
+    World->SolverTolerance = 0.03f;
+    World->WarmStartFactor = 1.f;
+    World->UseSplitImpulse = true;
+    World->PositionIterations = 2;
+    World->UseBlockSolver = true;
+    World->UsePatchFriction = false;
+    World->UseSoftStep = false;
+    World->SubstepCount = 4;
+    World->UseWideSolver = true;
+    World->UseSolverThreads = true;
+    World->EnableSleeping = true;
+    // 1 unit = 1cm, the same thresholds as Box2D.
+    World->LinearSleepVelocity = 1.f;
+    World->AngularSleepVelocity = DegreesToRadians(2.f);
+    World->TimeToSleep = 0.5f;
+    World->MaxJoints = 256;
+    World->Joints = ArenaPushArray(PersistentArena(), World->MaxJoints, joint);
     World->Camera.FocusPosition = V3(0,0,0);
     World->Camera.LatAngle = 0;
     World->Camera.LngAngle = 0;
     World->Camera.Radius = 300.f;
 }
 
-void DEBUGCreateBoxRigidBody(arena *Arena, rigid_body *Body, float Width, float Depth, float Height, float Mass)
+void SetRigidBodyMass(rigid_body *Body, float Mass, v3 InertiaDiagonal)
+{
+    Body->Mass = Mass;
+    Body->InverseMass = 0;
+    Body->Inertia = {};
+    Body->InverseInertia = {};
+
+    if (Mass != 0)
+    {
+        Body->InverseMass = 1.f / Mass;
+        for (i32 i = 0; i < 3; ++i)
+        {
+            Body->Inertia[i][i] = InertiaDiagonal[i];
+            Body->InverseInertia[i][i] = 1.f / InertiaDiagonal[i];
+        }
+    }
+}
+
+void SetRigidBodyMass(rigid_body *Body, float Mass, m3x3 Inertia)
+{
+    Body->Mass = Mass;
+    Body->InverseMass = 0;
+    Body->Inertia = {};
+    Body->InverseInertia = {};
+
+    if (Mass != 0)
+    {
+        Body->InverseMass = 1.f / Mass;
+        Body->Inertia = Inertia;
+        Body->InverseInertia = Inverse(Inertia);
+    }
+}
+
+hull *GetCachedBoxHull(hull_cache *Cache, arena *Arena, v3 HalfExtents)
+{
+    for (i32 i = 0; i < Cache->EntryCount; ++i)
+    {
+        hull_cache_entry *Entry = Cache->Entries + i;
+        if (Entry->Kind == HullCacheKind_Box &&
+            Entry->Parameters.x == HalfExtents.x &&
+            Entry->Parameters.y == HalfExtents.y &&
+            Entry->Parameters.z == HalfExtents.z)
+        {
+            return Entry->Hull;
+        }
+    }
+
+    ASSERT(Cache->EntryCount < Cache->MaxEntries);
+    hull_cache_entry *Entry = Cache->Entries + Cache->EntryCount++;
+    Entry->Kind = HullCacheKind_Box;
+    Entry->Parameters = HalfExtents;
+    Entry->Hull = DEBUGCreateBoxHull(Arena, -HalfExtents, HalfExtents);
+    return Entry->Hull;
+}
+
+void DEBUGCreateBoxRigidBody(world *World, rigid_body *Body, float Width, float Depth, float Height, float Mass)
 {
     memset(Body, 0, sizeof(rigid_body));
     Body->Type = RigidBodyType_Dynamic;
+    Body->ShapeType = ShapeType_Hull;
 
     v3 Max = V3(Width/2.f, Depth/2.f, Height/2.f);
     v3 Min = -Max;
 
-    Body->Hull = DEBUGCreateBoxHull(Arena, Min, Max);
-    Body->DEBUGModel.Min = Min;
-    Body->DEBUGModel.Max = Max;
+    // Every box shares the unit box hull.
+    Body->Hull = GetCachedBoxHull(&World->HullCache, &World->HullArena, V3(0.5f, 0.5f, 0.5f));
+    Body->Scale = V3(Width, Depth, Height);
+    Body->LocalCenterOfMass = Hadamard(Body->Hull->Centroid, Body->Scale);
     Body->BoundingVolume.Min = Min;
     Body->BoundingVolume.Max = Max;
-    Body->Orientation = Rotation(V3(1,0,0), 0);
 
-    Body->Mass = Mass;
+    v3 Inertia;
+    Inertia.x = (1.f / 12.f) * Mass * (Square(Height) + Square(Depth));
+    Inertia.y = (1.f / 12.f) * Mass * (Square(Width)  + Square(Depth));
+    Inertia.z = (1.f / 12.f) * Mass * (Square(Width)  + Square(Height));
+    SetRigidBodyMass(Body, Mass, Inertia);
+}
+
+void CreateSphereRigidBody(rigid_body *Body, float Radius, float Mass)
+{
+    memset(Body, 0, sizeof(rigid_body));
+    Body->Type = RigidBodyType_Dynamic;
+    Body->ShapeType = ShapeType_Sphere;
+
+    Body->Sphere.Center = V3(0,0,0);
+    Body->Sphere.Radius = Radius;
+    Body->LocalCenterOfMass = V3(0,0,0);
+    Body->BoundingVolume.Min = V3(-Radius, -Radius, -Radius);
+    Body->BoundingVolume.Max = V3(Radius, Radius, Radius);
+
+    float I = (2.f / 5.f) * Mass * Square(Radius);
+    SetRigidBodyMass(Body, Mass, V3(I, I, I));
+}
+
+// The capsule segment runs along the local z axis.
+void CreateCapsuleRigidBody(rigid_body *Body, float HalfHeight, float Radius, float Mass)
+{
+    memset(Body, 0, sizeof(rigid_body));
+    Body->Type = RigidBodyType_Dynamic;
+    Body->ShapeType = ShapeType_Capsule;
+
+    Body->Capsule.P = V3(0, 0, -HalfHeight);
+    Body->Capsule.Q = V3(0, 0, HalfHeight);
+    Body->Capsule.Radius = Radius;
+    Body->LocalCenterOfMass = V3(0,0,0);
+    Body->BoundingVolume.Min = V3(-Radius, -Radius, -HalfHeight - Radius);
+    Body->BoundingVolume.Max = V3(Radius, Radius, HalfHeight + Radius);
+
+    // Split the mass between the cylinder and the two hemispheres by volume.
+    float Height = 2.f * HalfHeight;
+    float CylinderVolume = M_PI * Square(Radius) * Height;
+    float SphereVolume = (4.f / 3.f) * M_PI * Square(Radius) * Radius;
+    float CylinderMass = Mass * CylinderVolume / (CylinderVolume + SphereVolume);
+    float SphereMass = Mass - CylinderMass;
 
-    if (Mass == 0)
+    float Axial = CylinderMass * Square(Radius) * 0.5f + SphereMass * Square(Radius) * (2.f / 5.f);
+    float Perpendicular =
+        CylinderMass * (Square(Height) / 12.f + Square(Radius) / 4.f) +
+        SphereMass * (Square(Radius) * (2.f / 5.f) + Square(Height) / 4.f + (3.f / 8.f) * Height * Radius);
+    SetRigidBodyMass(Body, Mass, V3(Perpendicular, Perpendicular, Axial));
+}
+
+void CreateHullRigidBody(rigid_body *Body, hull *Hull, float Mass)
+{
+    memset(Body, 0, sizeof(rigid_body));
+    Body->Type = RigidBodyType_Dynamic;
+    Body->ShapeType = ShapeType_Hull;
+    Body->Hull = Hull;
+    Body->Scale = V3(1, 1, 1);
+
+    aabb Bounds;
+    Bounds.Min = V3(FLT_MAX, FLT_MAX, FLT_MAX);
+    Bounds.Max = -Bounds.Min;
+    for (i32 i = 0; i < Hull->VertexCount; ++i)
     {
-        Body->InverseMass = 0;
+        for (i32 Axis = 0; Axis < 3; ++Axis)
+        {
+            Bounds.Min[Axis] = Min(Bounds.Min[Axis], Hull->Vertices[i][Axis]);
+            Bounds.Max[Axis] = Max(Bounds.Max[Axis], Hull->Vertices[i][Axis]);
+        }
     }
-    else
+    Body->BoundingVolume = Bounds;
+
+    mass_properties MassProperties = ComputeHullMassProperties(Hull);
+    Body->LocalCenterOfMass = MassProperties.Centroid;
+
+    m3x3 Inertia = {};
+    if (MassProperties.Volume > 0.f)
     {
-        Body->InverseMass = 1.f / Mass;
+        float Density = Mass / MassProperties.Volume;
+        for (i32 i = 0; i < 3; ++i)
+        {
+            for (i32 j = 0; j < 3; ++j)
+            {
+                Inertia[i][j] = MassProperties.Inertia[i][j] * Density;
+            }
+        }
     }
+    SetRigidBodyMass(Body, Mass, Inertia);
+}
 
-    if (Mass != 0)
-    {
-        float Ix = (1.f / 12.f) * Mass * (Square(Height) + Square(Depth));
-        float Iy = (1.f / 12.f) * Mass * (Square(Width)  + Square(Depth));
-        float Iz = (1.f / 12.f) * Mass * (Square(Width)  + Square(Height));
+void CreateCompoundRigidBody(rigid_body *Body, compound *Compound, float Mass)
+{
+    memset(Body, 0, sizeof(rigid_body));
+    Body->Type = RigidBodyType_Dynamic;
+    Body->ShapeType = ShapeType_Compound;
+    Body->Compound = Compound;
+    Body->Scale = V3(1, 1, 1);
+
+    // The root node bounds every child.
+    Body->BoundingVolume = Compound->Nodes[0].Bounds;
 
-        Body->Inertia[0][0] = Ix;
-        Body->Inertia[1][1] = Iy;
-        Body->Inertia[2][2] = Iz;
+    mass_properties MassProperties = ComputeCompoundMassProperties(Compound);
+    Body->LocalCenterOfMass = MassProperties.Centroid;
 
-        Body->InverseInertia[0][0] = 1.f / Ix;
-        Body->InverseInertia[1][1] = 1.f / Iy;
-        Body->InverseInertia[2][2] = 1.f / Iz;
+    m3x3 Inertia = {};
+    if (MassProperties.Volume > 0.f)
+    {
+        float Density = Mass / MassProperties.Volume;
+        for (i32 i = 0; i < 3; ++i)
+        {
+            for (i32 j = 0; j < 3; ++j)
+            {
+                Inertia[i][j] = MassProperties.Inertia[i][j] * Density;
+            }
+        }
     }
+    SetRigidBodyMass(Body, Mass, Inertia);
+}
+
+// Meshes can only be static, they have no mass.
+void CreateTriangleMeshRigidBody(rigid_body *Body, triangle_mesh *Mesh)
+{
+    memset(Body, 0, sizeof(rigid_body));
+    Body->Type = RigidBodyType_Static;
+    Body->ShapeType = ShapeType_TriangleMesh;
+    Body->Mesh = Mesh;
+    Body->Scale = V3(1, 1, 1);
+    Body->BoundingVolume = Mesh->Bounds;
+}
+
+void CreateHeightfieldRigidBody(rigid_body *Body, heightfield *Field)
+{
+    memset(Body, 0, sizeof(rigid_body));
+    Body->Type = RigidBodyType_Static;
+    Body->ShapeType = ShapeType_Heightfield;
+    Body->Heightfield = Field;
+    Body->Scale = V3(1, 1, 1);
+    Body->BoundingVolume = Field->Bounds;
 }
 
 entity_handle DEBUGCreateRigidBody(float Width, float Depth, float Height, float Mass,
@@ -102,14 +367,211 @@ entity_handle DEBUGCreateRigidBody(float Width, float Depth, float Height, float
 
     rigid_body *Entity;
     i32 EntityID = CreateEntity(&Entity);
-    DEBUGCreateBoxRigidBody(&World->HullArena, Entity, Width, Depth, Height, Mass);
-    Entity->Position = Position;
-    Entity->Orientation = Orientation;
+    DEBUGCreateBoxRigidBody(World, Entity, Width, Depth, Height, Mass);
+    World->RenderData[EntityID].DEBUGModel = Entity->BoundingVolume;
+    SetBodyPose(EntityID, Position, Orientation);
     Entity->Recalculate();
-    Entity->RecalculateModelMatrix();
     return EntityID;
 }
 
+entity_handle CreateSphere(float Radius, float Mass,
+                           v3 Position = V3(0,0,0))
+{
+    world *World = GetWorld();
+
+    rigid_body *Entity;
+    i32 EntityID = CreateEntity(&Entity);
+    CreateSphereRigidBody(Entity, Radius, Mass);
+    World->RenderData[EntityID].DEBUGModel = Entity->BoundingVolume;
+    SetBodyPose(EntityID, Position, Rotation(V3(1,0,0), 0));
+    Entity->Recalculate();
+    return EntityID;
+}
+
+// Returns 0 if no hull could be built from the points.
+entity_handle CreateConvexHull(v3 *Points, i32 PointCount, float Mass,
+                               v3 Position = V3(0,0,0),
+                               quaternion Orientation = Rotation(V3(1,0,0),0))
+{
+    world *World = GetWorld();
+
+    hull *Hull = QuickHull(&World->HullArena, Points, PointCount);
+    if (!Hull)
+    {
+        return 0;
+    }
+
+    rigid_body *Entity;
+    i32 EntityID = CreateEntity(&Entity);
+    CreateHullRigidBody(Entity, Hull, Mass);
+    World->RenderData[EntityID].DEBUGModel = Entity->BoundingVolume;
+    SetBodyPose(EntityID, Position, Orientation);
+    Entity->Recalculate();
+    return EntityID;
+}
+
+entity_handle CreateCapsule(float HalfHeight, float Radius, float Mass,
+                            v3 Position = V3(0,0,0),
+                            quaternion Orientation = Rotation(V3(1,0,0),0))
+{
+    world *World = GetWorld();
+
+    rigid_body *Entity;
+    i32 EntityID = CreateEntity(&Entity);
+    CreateCapsuleRigidBody(Entity, HalfHeight, Radius, Mass);
+    World->RenderData[EntityID].DEBUGModel = Entity->BoundingVolume;
+    SetBodyPose(EntityID, Position, Orientation);
+    Entity->Recalculate();
+    return EntityID;
+}
+
+// Child transforms are relative to the body frame, the mass is spread by volume.
+entity_handle CreateCompound(compound_child *Children, i32 ChildCount, float Mass,
+                             v3 Position = V3(0,0,0),
+                             quaternion Orientation = Rotation(V3(1,0,0),0))
+{
+    world *World = GetWorld();
+
+    compound *Compound = BuildCompound(&World->HullArena, Children, ChildCount);
+
+    rigid_body *Entity;
+    i32 EntityID = CreateEntity(&Entity);
+    CreateCompoundRigidBody(Entity, Compound, Mass);
+    World->RenderData[EntityID].DEBUGModel = Entity->BoundingVolume;
+    SetBodyPose(EntityID, Position, Orientation);
+    Entity->Recalculate();
+    return EntityID;
+}
+
+entity_handle CreateTriangleMesh(v3 *Vertices, i32 VertexCount, u32 *Indices, i32 TriangleCount,
+                                 v3 Position = V3(0,0,0),
+                                 quaternion Orientation = Rotation(V3(1,0,0),0))
+{
+    world *World = GetWorld();
+
+    triangle_mesh *Mesh = BuildTriangleMesh(&World->HullArena, Vertices, VertexCount, Indices, TriangleCount);
+
+    rigid_body *Entity;
+    i32 EntityID = CreateEntity(&Entity);
+    CreateTriangleMeshRigidBody(Entity, Mesh);
+    World->RenderData[EntityID].DEBUGModel = Entity->BoundingVolume;
+    SetBodyPose(EntityID, Position, Orientation);
+    Entity->Recalculate();
+    return EntityID;
+}
+
+entity_handle CreateHeightfield(float *Heights, i32 SamplesX, i32 SamplesY, float CellSize,
+                                v3 Position = V3(0,0,0),
+                                quaternion Orientation = Rotation(V3(1,0,0),0))
+{
+    world *World = GetWorld();
+
+    heightfield *Field = BuildHeightfield(&World->HullArena, Heights, SamplesX, SamplesY, CellSize);
+
+    rigid_body *Entity;
+    i32 EntityID = CreateEntity(&Entity);
+    CreateHeightfieldRigidBody(Entity, Field);
+    World->RenderData[EntityID].DEBUGModel = Entity->BoundingVolume;
+    SetBodyPose(EntityID, Position, Orientation);
+    Entity->Recalculate();
+    return EntityID;
+}
+
+// Joints are given in world space at the current pose of the bodies, which becomes the
+// rest pose. Returns 0 once the pool is full.
+joint *CreateJoint(joint_type Type, entity_handle EntityA, entity_handle EntityB, v3 Anchor)
+{
+    world *World = GetWorld();
+    if (World->JointCount == World->MaxJoints)
+    {
+        return 0;
+    }
+
+    rigid_body *A = GetEntityByHandle(EntityA);
+    rigid_body *B = GetEntityByHandle(EntityB);
+    joint *Joint = World->Joints + World->JointCount++;
+    *Joint = {};
+    Joint->Type = Type;
+    Joint->EntityA = EntityA;
+    Joint->EntityB = EntityB;
+    transform PoseA = GetBodyPose(EntityA);
+    transform PoseB = GetBodyPose(EntityB);
+    Joint->LocalAnchorA = PointToLocalSpace(Anchor, PoseA);
+    Joint->LocalAnchorB = PointToLocalSpace(Anchor, PoseB);
+    Joint->ReferenceRotation = Conjugate(PoseA.Rotation) * PoseB.Rotation;
+    A->JointCount++;
+    B->JointCount++;
+    WakeBody(EntityA);
+    WakeBody(EntityB);
+    return Joint;
+}
+
+joint *CreateBallJoint(entity_handle EntityA, entity_handle EntityB, v3 Anchor)
+{
+    return CreateJoint(JointType_Ball, EntityA, EntityB, Anchor);
+}
+
+joint *CreateFixedJoint(entity_handle EntityA, entity_handle EntityB, v3 Anchor)
+{
+    return CreateJoint(JointType_Fixed, EntityA, EntityB, Anchor);
+}
+
+// Angles are relative to the current pose, counter clockwise around the axis.
+joint *CreateHingeJoint(entity_handle EntityA, entity_handle EntityB, v3 Anchor, v3 Axis)
+{
+    joint *Joint = CreateJoint(JointType_Hinge, EntityA, EntityB, Anchor);
+    if (Joint)
+    {
+        Axis = Normalized(Axis);
+        Joint->LocalAxisA = RotateVector(Axis, Conjugate(GetBodyPose(EntityA).Rotation));
+        Joint->LocalAxisB = RotateVector(Axis, Conjugate(GetBodyPose(EntityB).Rotation));
+    }
+    return Joint;
+}
+
+void SetHingeLimits(joint *Joint, float LowerAngle, float UpperAngle)
+{
+    ASSERT(Joint->Type == JointType_Hinge && LowerAngle <= UpperAngle);
+    Joint->EnableLimit = true;
+    Joint->LowerAngle = LowerAngle;
+    Joint->UpperAngle = UpperAngle;
+}
+
+void SetHingeMotor(joint *Joint, float Speed, float MaxTorque)
+{
+    ASSERT(Joint->Type == JointType_Hinge);
+    Joint->EnableMotor = MaxTorque > 0.f;
+    Joint->MotorSpeed = Speed;
+    Joint->MaxMotorTorque = MaxTorque;
+    WakeBody(Joint->EntityA);
+    WakeBody(Joint->EntityB);
+}
+
+// Keeps the anchors at their current distance.
+joint *CreateDistanceJoint(entity_handle EntityA, entity_handle EntityB, v3 AnchorA, v3 AnchorB)
+{
+    joint *Joint = CreateJoint(JointType_Distance, EntityA, EntityB, AnchorA);
+    if (Joint)
+    {
+        Joint->LocalAnchorB = PointToLocalSpace(AnchorB, GetBodyPose(EntityB));
+        Joint->Length = Length(AnchorB - AnchorA);
+        // Only the distance is kept, the bodies can still swing into each other.
+        Joint->CollideConnected = true;
+    }
+    return Joint;
+}
+
+// The last joint takes the place of the removed one, so pointers to it are invalidated.
+void RemoveJoint(joint *Joint)
+{
+    world *World = GetWorld();
+    GetEntityByHandle(Joint->EntityA)->JointCount--;
+    GetEntityByHandle(Joint->EntityB)->JointCount--;
+    WakeBody(Joint->EntityA);
+    WakeBody(Joint->EntityB);
+    *Joint = World->Joints[--World->JointCount];
+}
+
 void Simulate(float dt)
 {
     world *World = GetWorld();
@@ -117,6 +579,7 @@ void Simulate(float dt)
     World->DEBUG_DetectedCollisions = 0;
     World->DEBUG_ReusedContacts = 0;
     World->DEBUG_NewContacts = 0;
+    World->StepIndex++;
 
     // 1 unit = 1cm
     float UnitsPerMeter = 100.f;
@@ -126,67 +589,104 @@ void Simulate(float dt)
     for (i32 i = 1; i < GetWorld()->EntityCount; ++i)
     {
         rigid_body *Entity = GetEntityByHandle(i);
-        if (Entity->Type == RigidBodyType_Dynamic)
+        if (Entity->IsSleeping)
+        {
+            continue;
+        }
+
+        if (Entity->Type == RigidBodyType_Dynamic && !World->UseSoftStep)
         {
             Entity->LinearMomentum += Gravity * Entity->Mass * dt;
         }
+        body_motion *Motion = GetBodyMotion(i);
+        Motion->BiasLinearVelocity = V3(0,0,0);
+        Motion->BiasAngularVelocity = V3(0,0,0);
         Entity->Recalculate();
-        Entity->RecalculateModelMatrix();
     }
 
-    Broadphase(World, PersistentArena());
-
-    for (i32 Iteration = 0;
-         Iteration < World->SolverIterations;
-         ++Iteration)
+    Broadphase(World);
+    BuildIslands(World);
+    PrepareContactConstraints(World, dt);
+    // The soft step solves the joints once per sub-step.
+    PrepareJointConstraints(World, World->UseSoftStep ? dt / Max(World->SubstepCount, 1) : dt);
+    ResetSolverStats(World);
+    if (World->UseSoftStep)
+    {
+        SolveSoftStep(World, Gravity, dt);
+    }
+    else
     {
-        for (i32 i = 0; i < World->CollisionPairCount; ++i)
+        WarmStartContactConstraints(World);
+        WarmStartJointConstraints(World);
+        PartitionContactIslands(World);
+        if (World->UseWideSolver)
         {
-            i32 EntityA = World->CollisionPairs[i].EntityA;
-            i32 EntityB = World->CollisionPairs[i].EntityB;
-            arbiter *Arbiter = GetArbiter(World, EntityA, EntityB);
+            BuildContactBatches(World);
+        }
 
-            if (!Arbiter || Arbiter->EntityA == 0)
+        SolveContactIslands(World);
+
+        // The large islands are solved together and stop once all of them have converged.
+        if (World->LargeIslandCount)
+        {
+            float Residuals[MAX_SOLVER_ITERATIONS];
+            i32 MaxIterations = GetSolverIterationCap(World);
+            i32 Iteration = 0;
+            while (Iteration < MaxIterations)
             {
-                continue;
+                float Residual = World->UseWideSolver ? SolveContactBatches(World) : SolveContactConstraints(World);
+                Residuals[Iteration++] = Residual;
+                if (IsSolverConverged(World, Iteration, Residual))
+                {
+                    break;
+                }
             }
+            AddSolverStats(World, Residuals, Iteration, Iteration * World->LargeIslandCount, World->LargeIslandCount);
+        }
 
-            ASSERT(Arbiter->EntityB != 0);
-            ApplyImpulses(Arbiter, dt);
+        if (World->UseSplitImpulse)
+        {
+            SolveContactPositions(World);
+        }
+
+        if (World->UseWideSolver)
+        {
+            StoreContactBatchImpulses(World);
         }
     }
+    StoreContactImpulses(World);
+    StoreJointImpulses(World);
 
-    quaternion AngularVelocity;
-    AngularVelocity.w = 0;
-    for (i32 i = 1; i < GetWorld()->EntityCount; ++i)
+    for (i32 i = 1; i < World->EntityCount; ++i)
     {
         rigid_body *Entity = GetEntityByHandle(i);
-        if (Entity->Type == RigidBodyType_Dynamic)
+        if (Entity->Type == RigidBodyType_Dynamic && !Entity->IsSleeping)
         {
-            Entity->Position += Entity->LinearVelocity * dt;
-            AngularVelocity.v = Entity->AngularVelocity;
-            Entity->Orientation += 0.5f * AngularVelocity * Entity->Orientation * dt;
+            Entity->RecalculateMomentum();
         }
     }
+
+    if (World->EnableSleeping)
+    {
+        UpdateSleep(World, dt);
+    }
+
+    if (World->UseSoftStep)
+    {
+        // Already moved by the sub-steps.
+        return;
+    }
+
+    IntegrateBodies(World, dt);
 }
 
 void ClearAllEntities(world *World)
 {
     ClearArena(&World->HullArena);
+    World->HullCache.EntryCount = 0;
     World->EntityCount = 1;
-
-    for (i32 i = 1; i < World->EntityCount; ++i)
-    {
-        // j = i+1 so we only loop over distinct pairs, otherwise we may eject an arbiter when we didnt mean to
-        for (i32 j = i+1; j < World->EntityCount; ++j)
-        {
-            arbiter *Arbiter = GetArbiter(World, i, j);
-            if (Arbiter)
-            {
-                *Arbiter = {};
-            }
-        }
-    }
+    World->JointCount = 0;
+    ClearArbiterTable(&World->Arbiters);
 }
 
 void ReinitSimulationState()
@@ -214,12 +714,173 @@ void ReinitSimulationState()
         }
     }
 
+    for (i32 i = 0; i < 4; ++i)
+    {
+        CreateSphere(12, 8, V3(i*48, -64, 256));
+    }
+
+    for (i32 i = 0; i < 2; ++i)
+    {
+        CreateCapsule(16, 8, 8, V3(32+i*96, -64, 320), Rotation(V3(1,0,0), DegreesToRadians(90.f)));
+    }
+
+    {
+        // A rock built from points on a squashed sphere.
+        v3 Points[48];
+        float GoldenAngle = M_PI * (3.f - sqrtf(5.f));
+        for (i32 i = 0; i < ARRAY_SIZE(Points); ++i)
+        {
+            float z = 1.f - 2.f * (i + 0.5f) / ARRAY_SIZE(Points);
+            float r = sqrtf(1.f - z*z);
+            float Theta = GoldenAngle * i;
+            Points[i] = V3(24.f * r * cosf(Theta), 18.f * r * sinf(Theta), 14.f * z);
+        }
+        CreateConvexHull(Points, ARRAY_SIZE(Points), 24, V3(192, -64, 256));
+    }
+
+    {
+        // A table, every part shares the unit box hull.
+        hull *Box = GetCachedBoxHull(&World->HullCache, &World->HullArena, V3(0.5f, 0.5f, 0.5f));
+        quaternion Identity = Rotation(V3(1,0,0), 0);
+        compound_child Children[5] = {};
+        Children[0] = {Box, V3(64, 40, 6), {V3(0, 0, 17), Identity}};
+        for (i32 i = 0; i < 4; ++i)
+        {
+            v3 Offset = V3((i & 1) ? 26.f : -26.f, (i & 2) ? 14.f : -14.f, 0);
+            Children[i+1] = {Box, V3(6, 6, 28), {Offset, Identity}};
+        }
+        CreateCompound(Children, ARRAY_SIZE(Children), 32, V3(-96, 96, 256));
+    }
+
+    {
+        // A bowl shaped mesh next to the ground box.
+        const i32 GridSize = 12;
+        float CellSize = 32.f;
+        v3 Vertices[(GridSize + 1) * (GridSize + 1)];
+        u32 Indices[GridSize * GridSize * 6];
+        for (i32 y = 0; y <= GridSize; ++y)
+        {
+            for (i32 x = 0; x <= GridSize; ++x)
+            {
+                float u = (float)x / GridSize * 2.f - 1.f;
+                float v = (float)y / GridSize * 2.f - 1.f;
+                float Height = 48.f * (Square(u) + Square(v)) + 6.f * sinf(4.f * u) * cosf(3.f * v);
+                Vertices[y * (GridSize + 1) + x] = V3(x * CellSize, y * CellSize, Height);
+            }
+        }
+
+        i32 IndexCount = 0;
+        for (i32 y = 0; y < GridSize; ++y)
+        {
+            for (i32 x = 0; x < GridSize; ++x)
+            {
+                u32 I0 = y * (GridSize + 1) + x;
+                u32 I1 = I0 + 1;
+                u32 I2 = I0 + GridSize + 1;
+                u32 I3 = I2 + 1;
+                Indices[IndexCount++] = I0; Indices[IndexCount++] = I1; Indices[IndexCount++] = I3;
+                Indices[IndexCount++] = I0; Indices[IndexCount++] = I3; Indices[IndexCount++] = I2;
+            }
+        }
+
+        v3 Origin = V3(-320 - GridSize * CellSize, -GridSize * CellSize * 0.5f, -64);
+        CreateTriangleMesh(Vertices, ARRAY_SIZE(Vertices), Indices, IndexCount / 3, Origin);
+
+        v3 Center = Origin + V3(GridSize * CellSize * 0.5f, GridSize * CellSize * 0.5f, 0);
+        DEBUGCreateRigidBody(32, 32, 32, 16, Center + V3(-48, 0, 128));
+        DEBUGCreateRigidBody(48, 24, 16, 16, Center + V3(48, 24, 160), Rotation(V3(0,1,0), DegreesToRadians(30.f)));
+        CreateSphere(12, 8, Center + V3(0, -64, 192));
+    }
+
+    {
+        // A flat floor of small tiles behind the bowl, the slab on it lies on a hundred
+        // triangles at once.
+        const i32 GridSize = 16;
+        float CellSize = 16.f;
+        v3 Vertices[(GridSize + 1) * (GridSize + 1)];
+        u32 Indices[GridSize * GridSize * 6];
+        for (i32 y = 0; y <= GridSize; ++y)
+        {
+            for (i32 x = 0; x <= GridSize; ++x)
+            {
+                Vertices[y * (GridSize + 1) + x] = V3(x * CellSize, y * CellSize, 0);
+            }
+        }
+
+        i32 IndexCount = 0;
+        for (i32 y = 0; y < GridSize; ++y)
+        {
+            for (i32 x = 0; x < GridSize; ++x)
+            {
+                u32 I0 = y * (GridSize + 1) + x;
+                u32 I1 = I0 + 1;
+                u32 I2 = I0 + GridSize + 1;
+                u32 I3 = I2 + 1;
+                Indices[IndexCount++] = I0; Indices[IndexCount++] = I1; Indices[IndexCount++] = I3;
+                Indices[IndexCount++] = I0; Indices[IndexCount++] = I3; Indices[IndexCount++] = I2;
+            }
+        }
+
+        v3 Origin = V3(-320 - GridSize * CellSize, 224, -64);
+        CreateTriangleMesh(Vertices, ARRAY_SIZE(Vertices), Indices, IndexCount / 3, Origin);
+
+        v3 Center = Origin + V3(GridSize * CellSize * 0.5f, GridSize * CellSize * 0.5f, 0);
+        DEBUGCreateRigidBody(160, 160, 8, 16, Center + V3(0, 0, 32), Rotation(V3(0,0,1), DegreesToRadians(15.f)));
+    }
+
+    {
+        // Rolling terrain on the other side of the ground box, raised around the border.
+        const i32 Samples = 33;
+        float CellSize = 16.f;
+        float Heights[Samples * Samples];
+        for (i32 y = 0; y < Samples; ++y)
+        {
+            for (i32 x = 0; x < Samples; ++x)
+            {
+                float u = (float)x / (Samples - 1) * 2.f - 1.f;
+                float v = (float)y / (Samples - 1) * 2.f - 1.f;
+                float Rim = Square(Max(fabsf(u), fabsf(v)));
+                Heights[y * Samples + x] = 64.f * Square(Rim) + 10.f * sinf(5.f * u + 1.f) * sinf(4.f * v);
+            }
+        }
+
+        float Size = (Samples - 1) * CellSize;
+        v3 Origin = V3(320, -Size * 0.5f, -64);
+        CreateHeightfield(Heights, Samples, Samples, CellSize, Origin);
+
+        v3 Center = Origin + V3(Size * 0.5f, Size * 0.5f, 0);
+        DEBUGCreateRigidBody(40, 24, 24, 16, Center + V3(-32, 32, 128), Rotation(V3(1,1,0), DegreesToRadians(40.f)));
+        CreateCapsule(16, 8, 8, Center + V3(48, -32, 160), Rotation(V3(0,1,0), DegreesToRadians(70.f)));
+        // Lies along a ridge and touches a couple dozen triangles.
+        DEBUGCreateRigidBody(128, 128, 8, 16, Center + V3(0, 128, 96));
+    }
+
+    {
+        // A chain hanging from a post, and a paddle driven by a hinge motor.
+        i32 Post = DEBUGCreateRigidBody(16, 16, 16, 0, V3(-182, -160, 336));
+        GetEntityByHandle(Post)->Type = RigidBodyType_Static;
+        i32 Previous = Post;
+        for (i32 i = 0; i < 6; ++i)
+        {
+            i32 Link = DEBUGCreateRigidBody(8, 8, 24, 4, V3(-160 + i*28, -160, 328));
+            SetBodyPose(Link, GetBodyPose(Link).Position, Rotation(V3(0,1,0), DegreesToRadians(90.f)));
+            GetEntityByHandle(Link)->Recalculate();
+            CreateBallJoint(Previous, Link, V3(-174 + i*28, -160, 328));
+            Previous = Link;
+        }
+
+        i32 Axle = DEBUGCreateRigidBody(8, 8, 8, 0, V3(160, -160, 48));
+        GetEntityByHandle(Axle)->Type = RigidBodyType_Static;
+        i32 Paddle = DEBUGCreateRigidBody(96, 8, 16, 16, V3(160, -160, 48));
+        joint *Hinge = CreateHingeJoint(Axle, Paddle, V3(160, -160, 48), V3(0, 0, 1));
+        SetHingeMotor(Hinge, 2.f, 5e6f);
+    }
+
     for (i32 i = 1; i < GetWorld()->EntityCount; ++i)
     {
         GetEntityByHandle(i)->LinearMomentum = {};
         GetEntityByHandle(i)->AngularMomentum = {};
         GetEntityByHandle(i)->Recalculate();
-        GetEntityByHandle(i)->RecalculateModelMatrix();
     }
 }
 
@@ -236,9 +897,13 @@ void UpdateAndRender(float FrameTimeInSeconds, app_input *Input)
         World->MaxEntities = 512;
         World->EntityCount = 1; // Leave a 'null' entity at index 0.
         World->Entities = ArenaPushArray(PersistentArena(), World->MaxEntities, rigid_body);
+        World->Motions = ArenaPushArray(PersistentArena(), World->MaxEntities, body_motion);
+        World->Poses = ArenaPushArray(PersistentArena(), World->MaxEntities, transform);
+        World->WorldBounds = ArenaPushArray(PersistentArena(), World->MaxEntities, aabb);
+        World->PoseChanged = ArenaPushArray(PersistentArena(), World->MaxEntities, bool);
+        World->RenderData = ArenaPushArray(PersistentArena(), World->MaxEntities, body_render_data);
 
-        World->MaxArbiters = 2048;
-        World->Arbiters = ArenaPushArray(PersistentArena(), World->MaxArbiters, arbiter);
+        InitArbiterTable(&World->Arbiters, 256);
 
         ReinitSimulationState();
     }
@@ -279,7 +944,62 @@ void UpdateAndRender(float FrameTimeInSeconds, app_input *Input)
     for (i32 i = 1; i < World->EntityCount; ++i)
     {
         rigid_body *Entity = GetEntityByHandle(i);
-        PushAABB(&RenderGroup, Entity->DEBUGModel, Entity->Transform, i == 1 ? V3(0,0.5,1) : V3(1,0.5,0.2*i));
+        transform Pose = GetBodyPose(i);
+        switch (Entity->ShapeType)
+        {
+            case ShapeType_Sphere:
+            {
+                PushSphere(&RenderGroup, SphereToWorldSpace(Entity->Sphere, Pose));
+            } break;
+
+            case ShapeType_Capsule:
+            {
+                capsule Capsule = CapsuleToWorldSpace(Entity->Capsule, Pose);
+                PushSphere(&RenderGroup, sphere{Capsule.P, Capsule.Radius});
+                PushSphere(&RenderGroup, sphere{Capsule.Q, Capsule.Radius});
+                aabb Cylinder;
+                Cylinder.Max = V3(Entity->Capsule.Radius, Entity->Capsule.Radius, Entity->Capsule.Q.z) * 0.7f;
+                Cylinder.Min = -Cylinder.Max;
+                PushAABB(&RenderGroup, Cylinder, Pose);
+            } break;
+
+            case ShapeType_Heightfield:
+            {
+                DEBUGPushHeightfield(&RenderGroup, Entity->Heightfield, Pose);
+            } break;
+
+            case ShapeType_TriangleMesh:
+            {
+                DEBUGPushTriangleMesh(&RenderGroup, Entity->Mesh, Pose);
+            } break;
+
+            case ShapeType_Compound:
+            {
+                // Only compounds of boxes are drawn for now.
+                compound *Compound = Entity->Compound;
+                for (i32 ChildIndex = 0; ChildIndex < Compound->ChildCount; ++ChildIndex)
+                {
+                    compound_child *Child = Compound->Children + ChildIndex;
+                    aabb Box;
+                    Box.Max = Child->Scale * 0.5f;
+                    Box.Min = -Box.Max;
+                    PushAABB(&RenderGroup, Box, TransformConcat(Pose, Child->Transform), V3(0.6f, 0.4f, 0.2f));
+                }
+            } break;
+
+            default:
+            {
+                // Boxes are drawn solid, any other hull as a wireframe.
+                if (Entity->Hull->VertexCount == 8 && Entity->Hull->FaceCount == 6)
+                {
+                    PushAABB(&RenderGroup, World->RenderData[i].DEBUGModel, Pose, i == 1 ? V3(0,0.5,1) : V3(1,0.5,0.2*i));
+                }
+                else
+                {
+                    DEBUGPushHull(&RenderGroup, Entity->Hull, Pose);
+                }
+            } break;
+        }
     }
 
     ImGui::NewFrame();
@@ -303,10 +1023,34 @@ void UpdateAndRender(float FrameTimeInSeconds, app_input *Input)
 
     ImGui::Separator();
 
-    ImGui::SliderInt("Sequential Impulses Iterations", &World->SolverIterations, 1, 20);
+    ImGui::SliderInt("Sequential Impulses Iterations", &World->SolverIterations, 1, MAX_SOLVER_ITERATIONS);
+    ImGui::SliderFloat("Solver tolerance", &World->SolverTolerance, 0.f, 10.f, "%.3f cm/s", ImGuiSliderFlags_Logarithmic);
+    ImGui::SliderFloat("Warm start factor", &World->WarmStartFactor, 0.f, 1.f);
+    ImGui::Checkbox("Split impulses", &World->UseSplitImpulse);
+    ImGui::SliderInt("Position iterations", &World->PositionIterations, 1, 10);
+    ImGui::Checkbox("Block solver", &World->UseBlockSolver);
+    ImGui::Checkbox("Patch friction", &World->UsePatchFriction);
+    ImGui::Checkbox("Soft step", &World->UseSoftStep);
+    ImGui::SliderInt("Sub-steps", &World->SubstepCount, 1, 16);
+    ImGui::Checkbox("SIMD solver", &World->UseWideSolver);
+    ImGui::Checkbox("Multithreaded solver", &World->UseSolverThreads);
+    ImGui::Checkbox("Sleeping", &World->EnableSleeping);
+    ImGui::SliderFloat("Linear sleep velocity", &World->LinearSleepVelocity, 0.f, 20.f, "%.2f cm/s", ImGuiSliderFlags_Logarithmic);
+    ImGui::SliderAngle("Angular sleep velocity", &World->AngularSleepVelocity, 0.f, 30.f, "%.1f deg/s");
+    ImGui::SliderFloat("Time to sleep", &World->TimeToSleep, 0.f, 2.f, "%.2f s");
     // ImGui::Checkbox("Show BVH visualization", &World->DEBUG_ShowBVH);
     ImGui::Text("SAT calls: %d", World->DEBUG_SATCalls);
     ImGui::Text("Collisions: %d", World->DEBUG_DetectedCollisions);
+    ImGui::Text("Awake bodies: %d", World->DEBUG_AwakeBodies);
+    ImGui::Text("Joints: %d", World->JointCount);
+    if (World->DEBUG_SolvedIslandCount)
+    {
+        ImGui::Text("Solver iterations: %.1f avg, %d max",
+                    (float)World->DEBUG_SolverIterationSum / World->DEBUG_SolvedIslandCount,
+                    World->DEBUG_MaxSolverIterations);
+        ImGui::PlotLines("Residuals", World->DEBUG_SolverResiduals, World->DEBUG_MaxSolverIterations,
+                         0, NULL, 0.f, FLT_MAX, ImVec2(0, 60));
+    }
 
     ImGui::End();
 
@@ -40,55 +40,90 @@ enum rigid_body_type
     RigidBodyType_Dynamic 
 };
 
+enum shape_type
+{
+    ShapeType_Hull = 0,
+    ShapeType_Sphere,
+    ShapeType_Capsule,
+    ShapeType_Compound,
+    ShapeType_TriangleMesh,
+    ShapeType_Heightfield,
+
+    ShapeType_Count
+};
+
+// Solver state of a body. It lives in its own array on the world, parallel to the
+// entities, so the solver loops only pull in what they use. Static bodies have zero
+// inverse mass and inertia here, which is also how the solver tells them apart.
+struct body_motion
+{
+    v3 LinearVelocity;
+    v3 AngularVelocity;
+    m3x3 WorldInverseInertia;
+    float InverseMass;
+
+    // Velocities from the position correction pass, only used to move the body in the
+    // current step so the correction never shows up as momentum.
+    v3 BiasLinearVelocity;
+    v3 BiasAngularVelocity;
+
+    // Motion since the start of the step, the soft step sub-steps use it to update the
+    // contact separations without running the collision detection again.
+    v3 DeltaPosition;
+    quaternion DeltaRotation;
+};
+
+// Shape, pose and everything else the solver doesn't touch. The collision code builds
+// temporary bodies for the children of compounds and the triangles of meshes, so the pose
+// and bounds stay next to the shape.
 struct rigid_body
 {
     i32 Type;
-    hull *Hull;
-    aabb DEBUGModel;
-
-    // State variables
+    i32 ShapeType;
+    // Shapes are stored in the local space of the body.
     union
     {
-        struct
-        {
-            v3 Position;
-            quaternion Orientation;
-        };
-        transform Transform;
+        hull *Hull;
+        sphere Sphere;
+        capsule Capsule;
+        compound *Compound;
+        triangle_mesh *Mesh;
+        heightfield *Heightfield;
     };
-    m4x4 ModelMatrix;
+    // Non-uniform scale applied to the hull, so that bodies of different sizes can share one.
+    v3 Scale;
+    // Local bounds of the shape, the pose and the world bounds are kept in the world.
     aabb BoundingVolume;
 
     v3 LinearMomentum;
     v3 AngularMomentum;
 
-    // Derived variables
-    v3 LinearVelocity;
-    v3 AngularVelocity;
+    // Sleeping bodies are skipped by the simulation until their island is woken up.
+    bool IsSleeping;
+    // Number of joints attached, the broadphase only looks for a joint between two
+    // bodies that both have one.
+    i32 JointCount;
+    // How long the body has been below the sleep velocities.
+    float SleepTime;
 
     // Constants
+    v3 LocalCenterOfMass;
     float Mass;
     float InverseMass;
     m3x3 Inertia;
     m3x3 InverseInertia;
     float Friction;
 
-    void Recalculate()
-    {
-        LinearVelocity = InverseMass * LinearMomentum;
-        m3x3 R = RotationMatrix3(Orientation);
-        AngularVelocity = 
-            R *
-            InverseInertia *
-            Transpose(R) *
-            AngularMomentum;
-        Orientation = Normalized(Orientation);
-    }
-
-    inline void RecalculateModelMatrix()
-    {
-        ModelMatrix = Translation(Position) * RotationMatrix(Orientation);
-    }
+    // Both move between the momentum here and the velocities in the body_motion, they
+    // are defined once the world is.
+    void Recalculate();
+    void RecalculateMomentum();
+};
+
+// Only read when drawing.
+struct body_render_data
+{
+    aabb DEBUGModel;
 };
 
 struct collision_pair
@@ -141,17 +176,306 @@ struct contact_manifold
     i32 PointCount;
     contact_point Points[4];
     v3 Normal;
+    // Friction directions, kept from step to step so the friction impulses can be reused.
+    v3 Tangent[2];
+    // Friction impulses at the center of the manifold, only used with patch friction.
+    float PatchImpulse[2];
+    float TwistImpulse;
+
+    // Which part of each body the manifold belongs to, e.g. the child of a compound.
+    i32 SubShapeA;
+    i32 SubShapeB;
 };
 
+// Extra manifolds are allocated in runs of a power of two, this many sizes.
+#define MANIFOLD_SIZE_CLASSES 24
+
+// Most pairs touch in one place, so the arbiter holds the first manifold itself. The rest,
+// for compounds, meshes and heightfields, go into a run from the pool of the table. A body
+// lying on a mesh or heightfield touches as many triangles as it covers.
 struct arbiter
 {
-    bool WasUpdated;
+    // Step in which the pair last collided, older arbiters are evicted.
+    u32 LastUpdatedStep;
     i32 EntityA;
     i32 EntityB;
 
+    i32 ManifoldCount;
     contact_manifold Manifold;
+    // Run holding manifolds 1 and up, NULL if there is none.
+    contact_manifold *ExtraManifolds;
+    i32 ExtraManifoldClass;
+};
+
+// Arbiters are stored densely, the table maps a pair of entities to an index into them.
+// Open addressing with linear probing, removals shift the following entries back so no
+// tombstones are needed. Growing moves the arbiters, so pointers to them don't survive
+// the creation of a new one.
+struct arbiter_table
+{
+    arena Arena;
+    u32 SlotMask;
+    u64 *Keys;
+    i32 *Indices;
+
+    i32 ArbiterCount;
+    i32 MaxArbiters;
+    arbiter *Arbiters;
+
+    // The runs have an arena of their own so they never move, freed ones are reused first.
+    // A free run keeps the next free run of its size in its first bytes.
+    arena ManifoldArena;
+    contact_manifold *FreeManifolds[MANIFOLD_SIZE_CLASSES];
+};
+
+// Everything the solver needs for one contact point, computed once per step.
+struct contact_constraint_point
+{
+    v3 RA;
+    v3 RB;
+    float NormalMass;
+    float TangentMass[2];
+    float Bias;
+    // Only set with split impulses, Bias is zero then.
+    float PositionBias;
+    // At the start of the step, for the soft step.
+    float Penetration;
+
+    float NormalImpulse;
+    float TangentImpulse[2];
+    float BiasImpulse;
+};
+
+// Two points of a manifold whose normal impulses are solved together.
+struct contact_block
+{
+    i32 Points[2];
+    // Upper triangle of the 2x2 effective mass matrix K and of its inverse.
+    float K[3];
+    float InverseK[3];
+};
+
+// Which body of a contact is static, picks the specialized solver for the constraint.
+enum
+{
+    ContactKind_Dynamic,
+    ContactKind_StaticA,
+    ContactKind_StaticB,
+};
+
+// Constraints of a step are built from the arbiters into one contiguous array, so the
+// solver iterations don't chase the arbiters and bodies through the table.
+struct alignas(64) contact_constraint
+{
+    i32 EntityA;
+    i32 EntityB;
+    i32 Kind;
+    v3 Normal;
+    v3 Tangent[2];
+    float Friction;
+
+    i32 PointCount;
+    contact_constraint_point Points[4];
+
+    // Points that are part of a block are skipped by the sequential normal solve.
+    i32 BlockCount;
+    u32 BlockedPoints;
+    contact_block Blocks[2];
+
+    // With patch friction the points only solve their normal impulses. Friction is one
+    // 2D constraint at the center of the manifold plus a twist about the normal, limited
+    // by the total normal impulse.
+    bool UsePatchFriction;
+    v3 PatchRA;
+    v3 PatchRB;
+    float PatchTangentMass[2];
+    float TwistMass;
+    // Average distance of the points from the center, the lever arm of the twist.
+    float FrictionRadius;
+    float PatchImpulse[2];
+    float TwistImpulse;
+
+    // Accumulated impulses are written back here after the last iteration.
+    contact_manifold *Manifold;
+};
+
+enum joint_type
+{
+    JointType_Ball,
+    JointType_Hinge,
+    JointType_Fixed,
+    JointType_Distance,
+};
+
+// Joints connect two bodies at an anchor given in the local space of each body. They
+// live in a pool on the world and are solved in the same loop as the contacts.
+struct joint
+{
+    i32 Type;
+    entity_handle EntityA;
+    entity_handle EntityB;
+    v3 LocalAnchorA;
+    v3 LocalAnchorB;
+    // Hinge axis, in the local space of each body.
+    v3 LocalAxisA;
+    v3 LocalAxisB;
+    // Rotation of B relative to A when the joint was made, the fixed joint holds it and
+    // the hinge angle is measured from it.
+    quaternion ReferenceRotation;
+    // Distance between the anchors of a distance joint.
+    float Length;
+
+    // Hinge limits in radians and a motor that drives the hinge to a speed with a limited
+    // torque.
+    bool EnableLimit;
+    float LowerAngle;
+    float UpperAngle;
+    bool EnableMotor;
+    float MotorSpeed;
+    float MaxMotorTorque;
+
+    // Bodies connected by a joint don't collide with each other unless this is set.
+    bool CollideConnected;
+
+    // Accumulated impulses of the last step, for warm starting.
+    v3 LinearImpulse;
+    v3 AngularImpulse;
+    float AxialImpulse;
+    float MotorImpulse;
+    float LowerImpulse;
+    float UpperImpulse;
+};
+
+// Rebuilt every step from the joints like the contact constraints. Hinges only use the
+// first two components of the angular impulse, one per direction perpendicular to the
+// axis.
+struct joint_constraint
+{
+    i32 Type;
+    entity_handle EntityA;
+    entity_handle EntityB;
+    v3 RA;
+    v3 RB;
+
+    // Soft constraint terms, see ContactSoftness.
+    float MassScale;
+    float ImpulseScale;
+    float BiasRate;
+
+    m3x3 LinearMass;
+    v3 LinearBias;
+    m3x3 AngularMass;
+    v3 AngularBias;
+
+    // Hinge axis or distance joint direction, and the rows along it.
+    v3 Axis;
+    v3 Perpendicular[2];
+    float AxialMass;
+    float AxialBias;
+    bool EnableLimit;
+    float LowerBias;
+    float UpperBias;
+    bool EnableMotor;
+    float MotorSpeed;
+    float MaxMotorImpulse;
+
+    v3 LinearImpulse;
+    v3 AngularImpulse;
+    float AxialImpulse;
+    float MotorImpulse;
+    float LowerImpulse;
+    float UpperImpulse;
+
+    // Accumulated impulses are written back here after the last iteration.
+    joint *Joint;
+};
+
+#define MIN_SOLVER_ITERATIONS 4
+#define MAX_SOLVER_ITERATIONS 32
+
+struct contact_island
+{
+    i32 FirstConstraint;
+    i32 ConstraintCount;
+    i32 FirstJoint;
+    i32 JointCount;
+};
+
+// One or more small islands, solved from start to finish by one worker. Every island
+// stops iterating on its own once it has converged.
+struct contact_island_task
+{
+    i32 FirstIsland;
+    i32 IslandCount;
+
+    // Merged into the solver stats of the world after all tasks are done.
+    i32 MaxIterations;
+    i32 IterationSum;
+    float Residuals[MAX_SOLVER_ITERATIONS];
+};
+
+#define MAX_CONTACT_COLORS 32
+
+struct contact_constraint_point_4x
+{
+    v3_4x RA;
+    v3_4x RB;
+    f32_4x NormalMass;
+    f32_4x TangentMass[2];
+    f32_4x Bias;
+
+    f32_4x NormalImpulse;
+    f32_4x TangentImpulse[2];
+};
+
+// Four constraints that share no dynamic body, one per lane, so the whole batch can be
+// solved at once without the lanes racing on the velocities. Empty lanes have entity 0
+// and zero masses.
+struct contact_constraint_4x
+{
+    i32 EntityA[4];
+    i32 EntityB[4];
+    contact_constraint *Constraints[4];
+    i32 PointCount;
+
+    v3_4x Normal;
+    v3_4x Tangent[2];
+    f32_4x Friction;
+    f32_4x InverseMassA;
+    f32_4x InverseMassB;
+    m3x3_4x InverseInertiaA;
+    m3x3_4x InverseInertiaB;
+
+    bool UsePatchFriction;
+    v3_4x PatchRA;
+    v3_4x PatchRB;
+    f32_4x PatchTangentMass[2];
+    f32_4x TwistMass;
+    f32_4x FrictionRadius;
+    f32_4x PatchImpulse[2];
+    f32_4x TwistImpulse;
+    contact_constraint_point_4x Points[4];
+};
 
-    arbiter *NextArbiter;
+enum hull_cache_kind
+{
+    HullCacheKind_Box,
+};
+
+struct hull_cache_entry
+{
+    i32 Kind;
+    v3 Parameters;
+    hull *Hull;
+};
+
+// Hulls that only depend on a few shape parameters are built once and shared by every
+// body using them.
+struct hull_cache
+{
+    i32 EntryCount;
+    i32 MaxEntries;
+    hull_cache_entry *Entries;
 };
 
 struct camera
@@ -168,25 +492,94 @@ struct camera
 struct world
 {
     arena HullArena;
+    hull_cache HullCache;
     camera Camera;
 
     bvh_tree BVH;
     i32 MaxEntities;
     i32 EntityCount;
     rigid_body *Entities;
-
-    i32 CollisionPairCount;
-    collision_pair *CollisionPairs;
-    i32 MaxArbiters;
-    arbiter *Arbiters;
-
+    body_motion *Motions;
+    // Indexed like the entities. Poses are written through SetBodyPose, which flags the
+    // world bounds as stale until UpdateBodyBounds.
+    transform *Poses;
+    aabb *WorldBounds;
+    bool *PoseChanged;
+    body_render_data *RenderData;
+
+    arbiter_table Arbiters;
+    u32 StepIndex;
+
+    i32 MaxJoints;
+    i32 JointCount;
+    joint *Joints;
+
+    // Rebuilt every step in the temporary arena. Constraints are sorted by island, the
+    // large islands come first and are solved together, the rest is split into tasks.
+    i32 ContactConstraintCount;
+    contact_constraint *ContactConstraints;
+    i32 LargeIslandConstraintCount;
+    i32 LargeIslandCount;
+    // Joint constraints are sorted the same way.
+    i32 JointConstraintCount;
+    joint_constraint *JointConstraints;
+    i32 LargeIslandJointCount;
+    i32 IslandTaskCount;
+    contact_island_task *IslandTasks;
+    contact_island *ContactIslands;
+
+    // Batches for the SIMD solver, constraints that didn't fit a color are solved one by
+    // one afterwards.
+    bool UseWideSolver;
+    bool UseSolverThreads;
+    i32 ContactBatchCount;
+    contact_constraint_4x *ContactBatches;
+    // Batches of color i are [ContactColorBatches[i], ContactColorBatches[i+1]).
+    i32 ContactColorBatches[MAX_CONTACT_COLORS + 1];
+    i32 OverflowConstraintCount;
+    i32 *OverflowConstraints;
+
+    // An island falls asleep once all of its bodies stayed under both speeds for
+    // TimeToSleep seconds.
+    bool EnableSleeping;
+    float LinearSleepVelocity;
+    float AngularSleepVelocity;
+    float TimeToSleep;
+    // Root of the island of every body for the current step, static bodies are never
+    // part of an island.
+    i32 *BodyIslands;
+
+    // Islands stop iterating once no point changes its velocity by more than the tolerance
+    // in an iteration, SolverIterations is only the cap.
     i32 SolverIterations;
+    float SolverTolerance;
+    // Share of the last step's impulses applied before the first iteration.
+    float WarmStartFactor;
+    // Penetration is resolved in a separate pass on the bias velocities instead of
+    // through the velocity solver.
+    bool UseSplitImpulse;
+    i32 PositionIterations;
+    // Normal impulses of point pairs are solved exactly as a small LCP, only used by the
+    // scalar solver.
+    bool UseBlockSolver;
+    // Friction per manifold instead of per point, 3 rows instead of 8 for a face contact.
+    bool UsePatchFriction;
+    // Replaces the solver with sub-steps on soft contacts, collision detection still runs
+    // once per step.
+    bool UseSoftStep;
+    i32 SubstepCount;
 
     bool DEBUG_ShowBVH;
     i32 DEBUG_SATCalls;
     i32 DEBUG_DetectedCollisions;
     i32 DEBUG_ReusedContacts;
     i32 DEBUG_NewContacts;
+    i32 DEBUG_AwakeBodies;
+    // Largest residual of any island after every iteration of the last step.
+    float DEBUG_SolverResiduals[MAX_SOLVER_ITERATIONS];
+    i32 DEBUG_MaxSolverIterations;
+    i32 DEBUG_SolverIterationSum;
+    i32 DEBUG_SolvedIslandCount;
 };
 
 struct app_state
@@ -203,4 +596,9 @@ arena* TemporaryArena();
 arena* PersistentArena();
 world* GetWorld();
 rigid_body* GetEntityByHandle(entity_handle Handle);
+body_motion* GetBodyMotion(entity_handle Handle);
+transform GetBodyPose(entity_handle Handle);
+void SetBodyPose(entity_handle Handle, v3 Position, quaternion Orientation);
+aabb UpdateBodyBounds(entity_handle Handle);
+void WakeBody(entity_handle Handle);
 
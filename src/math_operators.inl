@@ -160,6 +160,45 @@ inline m3x3 operator*(m3x3 a, m3x3 b)
     return result;
 }
 
+inline m3x3 operator+(m3x3 a, m3x3 b)
+{
+    m3x3 result;
+    for (int i = 0; i < 3; ++i)
+    {
+        for (int j = 0; j < 3; ++j)
+        {
+            result.e[i][j] = a[i][j] + b[i][j];
+        }
+    }
+    return result;
+}
+
+inline m3x3 operator-(m3x3 a, m3x3 b)
+{
+    m3x3 result;
+    for (int i = 0; i < 3; ++i)
+    {
+        for (int j = 0; j < 3; ++j)
+        {
+            result.e[i][j] = a[i][j] - b[i][j];
+        }
+    }
+    return result;
+}
+
+inline m3x3 operator*(float s, m3x3 a)
+{
+    m3x3 result;
+    for (int i = 0; i < 3; ++i)
+    {
+        for (int j = 0; j < 3; ++j)
+        {
+            result.e[i][j] = s * a[i][j];
+        }
+    }
+    return result;
+}
+
 inline v3 operator*(m3x3 a, v3 v)
 {
     v3 result;
@@ -103,6 +103,12 @@ inline float Dot(v3 a, v3 b)
     return a.x * b.x + a.y * b.y + a.z * b.z;
 }
 
+// Component-wise product.
+inline v3 Hadamard(v3 a, v3 b)
+{
+    return V3(a.x * b.x, a.y * b.y, a.z * b.z);
+}
+
 inline float LengthSquared(v3 v)
 {
     return v.x*v.x + v.y*v.y + v.z*v.z;
@@ -220,6 +226,35 @@ inline m3x3 Transpose(m3x3 m)
     return result;
 }
 
+inline float Determinant(m3x3 m)
+{
+    return m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) -
+           m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+           m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+}
+
+inline m3x3 Inverse(m3x3 m)
+{
+    m3x3 result = {};
+    float det = Determinant(m);
+    if (det == 0.f)
+    {
+        return result;
+    }
+
+    float inv_det = 1.f / det;
+    result[0][0] = (m[1][1] * m[2][2] - m[1][2] * m[2][1]) * inv_det;
+    result[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * inv_det;
+    result[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * inv_det;
+    result[1][0] = (m[1][2] * m[2][0] - m[1][0] * m[2][2]) * inv_det;
+    result[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * inv_det;
+    result[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * inv_det;
+    result[2][0] = (m[1][0] * m[2][1] - m[1][1] * m[2][0]) * inv_det;
+    result[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * inv_det;
+    result[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * inv_det;
+    return result;
+}
+
 inline m4x4 IdentityMatrix()
 {
     m4x4 result = {};
@@ -230,6 +265,28 @@ inline m4x4 IdentityMatrix()
     return result;
 }
 
+inline m3x3 IdentityMatrix3()
+{
+    m3x3 result = {};
+    result[0][0] = 1.f;
+    result[1][1] = 1.f;
+    result[2][2] = 1.f;
+    return result;
+}
+
+// Cross product as a matrix, CrossProductMatrix(a) * b == Cross(a, b).
+inline m3x3 CrossProductMatrix(v3 a)
+{
+    m3x3 result = {};
+    result[0][1] = -a.z;
+    result[0][2] = a.y;
+    result[1][0] = a.z;
+    result[1][2] = -a.x;
+    result[2][0] = -a.y;
+    result[2][1] = a.x;
+    return result;
+}
+
 inline m4x4 Transpose(m4x4 m)
 {
     m4x4 result;
@@ -1,293 +1,2860 @@
-v3 VelocityAtPoint(rigid_body *Body, v3 P)
+v3 VelocityAtPoint(entity_handle Handle, v3 P)
 {
-    v3 X = PointToWorldSpace(Body->Hull->Centroid, Body->Transform);
-    return Body->LinearVelocity + Cross(Body->AngularVelocity, P - X);
+    rigid_body *Body = GetEntityByHandle(Handle);
+    body_motion *Motion = GetBodyMotion(Handle);
+    v3 X = PointToWorldSpace(Body->LocalCenterOfMass, GetBodyPose(Handle));
+    return Motion->LinearVelocity + Cross(Motion->AngularVelocity, P - X);
 }
 
 // @TODO: Maybe center of mass should just be the body's position (would simplify code)
-v3 CenterOfMass(rigid_body *Body)
+v3 CenterOfMass(entity_handle Handle)
 {
-    v3 Centroid = Body->Hull->Centroid;
-    return PointToWorldSpace(Centroid, Body->Transform);
+    return PointToWorldSpace(GetEntityByHandle(Handle)->LocalCenterOfMass, GetBodyPose(Handle));
 }
 
-arbiter *GetArbiter(world *World, i32 EntityA, i32 EntityB, arena *Arena = NULL)
+// Zero is the empty key, which is fine since entity 0 is the null entity.
+inline u64 ArbiterKey(i32 EntityA, i32 EntityB)
 {
     if (EntityA > EntityB)
     {
-        // Ensure EntityA has the smallest ID
         i32 Temp = EntityA;
         EntityA = EntityB;
         EntityB = Temp;
     }
+    return ((u64)EntityA << 32) | (u32)EntityB;
+}
+
+inline u32 ArbiterSlot(arbiter_table *Table, u64 Key)
+{
+    return (u32)((Key * 0x9E3779B97F4A7C15ull) >> 32) & Table->SlotMask;
+}
+
+// Returns the slot holding the key, or the empty slot where it would be inserted.
+inline u32 FindArbiterSlot(arbiter_table *Table, u64 Key)
+{
+    u32 Slot = ArbiterSlot(Table, Key);
+    while (Table->Keys[Slot] != 0 && Table->Keys[Slot] != Key)
+    {
+        Slot = (Slot + 1) & Table->SlotMask;
+    }
+    return Slot;
+}
+
+// The table is kept at most half full.
+void ResizeArbiterTable(arbiter_table *Table, i32 MaxArbiters)
+{
+    temporary_memory Temp = BeginTemporaryMemory(TemporaryArena());
+    i32 ArbiterCount = Table->ArbiterCount;
+    arbiter *Arbiters = ArenaPushArray(TemporaryArena(), ArbiterCount, arbiter);
+    memcpy(Arbiters, Table->Arbiters, ArbiterCount * sizeof(arbiter));
+
+    u32 SlotCount = 1;
+    while (SlotCount < (u32)MaxArbiters * 2)
+    {
+        SlotCount <<= 1;
+    }
+
+    ClearArena(&Table->Arena);
+    Table->SlotMask = SlotCount - 1;
+    Table->Keys = ArenaPushArray(&Table->Arena, SlotCount, u64);
+    Table->Indices = ArenaPushArray(&Table->Arena, SlotCount, i32);
+    Table->MaxArbiters = MaxArbiters;
+    Table->Arbiters = ArenaPushArray(&Table->Arena, MaxArbiters, arbiter);
+
+    memcpy(Table->Arbiters, Arbiters, ArbiterCount * sizeof(arbiter));
+    for (i32 i = 0; i < ArbiterCount; ++i)
+    {
+        u64 Key = ArbiterKey(Arbiters[i].EntityA, Arbiters[i].EntityB);
+        u32 Slot = FindArbiterSlot(Table, Key);
+        Table->Keys[Slot] = Key;
+        Table->Indices[Slot] = i;
+    }
+
+    EndTemporaryMemory(Temp);
+}
+
+void InitArbiterTable(arbiter_table *Table, i32 MaxArbiters)
+{
+    *Table = {};
+    Table->Arena = CreateArena();
+    Table->ManifoldArena = CreateArena();
+    ResizeArbiterTable(Table, MaxArbiters);
+}
+
+void ClearArbiterTable(arbiter_table *Table)
+{
+    memset(Table->Keys, 0, (Table->SlotMask + 1) * sizeof(u64));
+    Table->ArbiterCount = 0;
+    ClearArena(&Table->ManifoldArena);
+    memset(Table->FreeManifolds, 0, sizeof(Table->FreeManifolds));
+}
+
+// Smallest size class whose runs hold Count manifolds.
+inline i32 ManifoldSizeClass(i32 Count)
+{
+    i32 Class = 0;
+    while ((1 << Class) < Count)
+    {
+        ++Class;
+    }
+    ASSERT(Class < MANIFOLD_SIZE_CLASSES);
+    return Class;
+}
+
+contact_manifold *AllocateManifolds(arbiter_table *Table, i32 SizeClass)
+{
+    contact_manifold *Run = Table->FreeManifolds[SizeClass];
+    if (Run)
+    {
+        Table->FreeManifolds[SizeClass] = *(contact_manifold **)Run;
+        return Run;
+    }
+
+    return (contact_manifold *)ArenaPushSizeAligned(&Table->ManifoldArena,
+                                                    sizeof(contact_manifold) << SizeClass, 16);
+}
+
+void FreeManifolds(arbiter_table *Table, contact_manifold *Run, i32 SizeClass)
+{
+    *(contact_manifold **)Run = Table->FreeManifolds[SizeClass];
+    Table->FreeManifolds[SizeClass] = Run;
+}
+
+inline contact_manifold *GetArbiterManifold(arbiter *Arbiter, i32 Index)
+{
+    if (Index == 0)
+    {
+        return &Arbiter->Manifold;
+    }
+    ASSERT(Arbiter->ExtraManifolds && Index - 1 < (1 << Arbiter->ExtraManifoldClass));
+    return Arbiter->ExtraManifolds + Index - 1;
+}
+
+arbiter *GetArbiter(world *World, i32 EntityA, i32 EntityB, bool Create = false)
+{
+    arbiter_table *Table = &World->Arbiters;
+    u64 Key = ArbiterKey(EntityA, EntityB);
+    u32 Slot = FindArbiterSlot(Table, Key);
+    if (Table->Keys[Slot] == Key)
+    {
+        return Table->Arbiters + Table->Indices[Slot];
+    }
+
+    if (!Create)
+    {
+        return NULL;
+    }
+
+    if (Table->ArbiterCount == Table->MaxArbiters)
+    {
+        ResizeArbiterTable(Table, 2 * Table->MaxArbiters);
+        Slot = FindArbiterSlot(Table, Key);
+    }
+
+    i32 Index = Table->ArbiterCount++;
+    Table->Keys[Slot] = Key;
+    Table->Indices[Slot] = Index;
+
+    arbiter *Arbiter = Table->Arbiters + Index;
+    memset(Arbiter, 0, sizeof(*Arbiter));
+    Arbiter->EntityA = (i32)(Key >> 32);
+    Arbiter->EntityB = (i32)(u32)Key;
+    return Arbiter;
+}
+
+void RemoveArbiter(world *World, arbiter *Arbiter)
+{
+    arbiter_table *Table = &World->Arbiters;
+    u32 Hole = FindArbiterSlot(Table, ArbiterKey(Arbiter->EntityA, Arbiter->EntityB));
+    ASSERT(Table->Keys[Hole] != 0);
+    i32 Index = Table->Indices[Hole];
+    if (Arbiter->ExtraManifolds)
+    {
+        FreeManifolds(Table, Arbiter->ExtraManifolds, Arbiter->ExtraManifoldClass);
+    }
+
+    // Shift back every following entry of the cluster that may live in the hole, that is
+    // whose home slot isn't between the hole and where it is now.
+    u32 Slot = (Hole + 1) & Table->SlotMask;
+    while (Table->Keys[Slot] != 0)
+    {
+        u32 Home = ArbiterSlot(Table, Table->Keys[Slot]);
+        if (((Slot - Home) & Table->SlotMask) >= ((Slot - Hole) & Table->SlotMask))
+        {
+            Table->Keys[Hole] = Table->Keys[Slot];
+            Table->Indices[Hole] = Table->Indices[Slot];
+            Hole = Slot;
+        }
+        Slot = (Slot + 1) & Table->SlotMask;
+    }
+    Table->Keys[Hole] = 0;
+
+    // Fill the gap in the dense array with the last arbiter.
+    i32 Last = --Table->ArbiterCount;
+    if (Index != Last)
+    {
+        arbiter *Moved = Table->Arbiters + Index;
+        *Moved = Table->Arbiters[Last];
+        u32 MovedSlot = FindArbiterSlot(Table, ArbiterKey(Moved->EntityA, Moved->EntityB));
+        Table->Indices[MovedSlot] = Index;
+    }
+}
+
+// Any two unit vectors perpendicular to the normal, so that friction is solved along fixed
+// directions and the accumulated impulses stay meaningful between iterations and steps.
+inline void ComputeTangentBasis(v3 Normal, v3 *Tangent0, v3 *Tangent1)
+{
+    if (fabsf(Normal.x) >= 0.57735f)
+    {
+        *Tangent0 = Normalized(V3(Normal.y, -Normal.x, 0.f));
+    }
+    else
+    {
+        *Tangent0 = Normalized(V3(0.f, Normal.z, -Normal.y));
+    }
+    *Tangent1 = Cross(Normal, *Tangent0);
+}
+
+void MergeContacts(arbiter *Arbiter, contact_manifold *NewManifolds, i32 NewManifoldCount)
+{
+    world *World = GetWorld();
+    arbiter_table *Table = &World->Arbiters;
+
+    temporary_memory Temp = BeginTemporaryMemory(TemporaryArena());
+    contact_manifold *MergedManifolds = ArenaPushArray(TemporaryArena(), NewManifoldCount, contact_manifold);
+
+    // The narrowphase reports the sub shapes in about the same order every step, so the
+    // search for the old manifold starts after the last one found.
+    i32 SearchStart = 0;
+
+    for (i32 ManifoldIndex = 0; ManifoldIndex < NewManifoldCount; ++ManifoldIndex)
+    {
+        contact_manifold *NewManifold = NewManifolds + ManifoldIndex;
+        contact_manifold *MergedManifold = MergedManifolds + ManifoldIndex;
+        *MergedManifold = *NewManifold;
+
+        // Contact IDs are only unique within a pair of sub shapes.
+        contact_manifold *OldManifold = NULL;
+        for (i32 k = 0; k < Arbiter->ManifoldCount; ++k)
+        {
+            i32 j = (SearchStart + k) % Arbiter->ManifoldCount;
+            contact_manifold *Manifold = GetArbiterManifold(Arbiter, j);
+            if (Manifold->SubShapeA == NewManifold->SubShapeA &&
+                Manifold->SubShapeB == NewManifold->SubShapeB)
+            {
+                OldManifold = Manifold;
+                SearchStart = j + 1;
+                break;
+            }
+        }
+
+        // Keep the friction directions of the old manifold, turned to the new normal, so
+        // the friction impulses still mean the same thing.
+        v3 Normal = Normalized(NewManifold->Normal);
+        if (OldManifold)
+        {
+            v3 Tangent = OldManifold->Tangent[0] - Dot(OldManifold->Tangent[0], Normal) * Normal;
+            if (LengthSquared(Tangent) > 0.01f)
+            {
+                MergedManifold->Tangent[0] = Normalized(Tangent);
+                MergedManifold->Tangent[1] = Cross(Normal, MergedManifold->Tangent[0]);
+            }
+            else
+            {
+                ComputeTangentBasis(Normal, &MergedManifold->Tangent[0], &MergedManifold->Tangent[1]);
+            }
+        }
+        else
+        {
+            ComputeTangentBasis(Normal, &MergedManifold->Tangent[0], &MergedManifold->Tangent[1]);
+        }
+
+        MergedManifold->PatchImpulse[0] = 0.f;
+        MergedManifold->PatchImpulse[1] = 0.f;
+        MergedManifold->TwistImpulse = 0.f;
+        if (OldManifold)
+        {
+            v3 PatchImpulse =
+                OldManifold->PatchImpulse[0] * OldManifold->Tangent[0] +
+                OldManifold->PatchImpulse[1] * OldManifold->Tangent[1];
+            MergedManifold->PatchImpulse[0] = Dot(PatchImpulse, MergedManifold->Tangent[0]);
+            MergedManifold->PatchImpulse[1] = Dot(PatchImpulse, MergedManifold->Tangent[1]);
+            MergedManifold->TwistImpulse = OldManifold->TwistImpulse;
+        }
+
+        for (int i = 0; i < NewManifold->PointCount; ++i)
+        {
+            contact_point *NewContact = NewManifold->Points + i;
+            int k = -1;
+            for (int j = 0; OldManifold && j < OldManifold->PointCount; ++j)
+            {
+                contact_point *OldContact = OldManifold->Points + j;
+                if (NewContact->ID.Type == OldContact->ID.Type &&
+                    NewContact->ID.Value == OldContact->ID.Value)
+                {
+                    k = j;
+                    break;
+                }
+            }
+
+            if (k > -1)
+            {
+                contact_point *Contact = MergedManifold->Points + i;
+                contact_point *OldContact = OldManifold->Points + k;
+                World->DEBUG_ReusedContacts++;
+
+                v3 FrictionImpulse =
+                    OldContact->FrictionImpulse * OldManifold->Tangent[0] +
+                    OldContact->TangentImpulse * OldManifold->Tangent[1];
+                Contact->NormalImpulse = OldContact->NormalImpulse;
+                Contact->FrictionImpulse = Dot(FrictionImpulse, MergedManifold->Tangent[0]);
+                Contact->TangentImpulse = Dot(FrictionImpulse, MergedManifold->Tangent[1]);
+                Contact->BiasImpulse = OldContact->BiasImpulse;
+            }
+            else
+            {
+                World->DEBUG_NewContacts++;
+                MergedManifold->Points[i] = *NewContact;
+            }
+        }
+    }
+
+    // The old run is only given back once everything has been merged out of it.
+    i32 SizeClass = NewManifoldCount > 1 ? ManifoldSizeClass(NewManifoldCount - 1) : -1;
+    if (Arbiter->ExtraManifolds && Arbiter->ExtraManifoldClass != SizeClass)
+    {
+        FreeManifolds(Table, Arbiter->ExtraManifolds, Arbiter->ExtraManifoldClass);
+        Arbiter->ExtraManifolds = NULL;
+    }
+    if (SizeClass != -1 && !Arbiter->ExtraManifolds)
+    {
+        Arbiter->ExtraManifolds = AllocateManifolds(Table, SizeClass);
+        Arbiter->ExtraManifoldClass = SizeClass;
+    }
+
+    Arbiter->ManifoldCount = NewManifoldCount;
+    for (i32 i = 0; i < NewManifoldCount; ++i)
+    {
+        *GetArbiterManifold(Arbiter, i) = MergedManifolds[i];
+    }
+
+    EndTemporaryMemory(Temp);
+}
+
+inline sphere SphereToWorldSpace(sphere Sphere, transform T)
+{
+    Sphere.Center = PointToWorldSpace(Sphere.Center, T);
+    return Sphere;
+}
+
+inline capsule CapsuleToWorldSpace(capsule Capsule, transform T)
+{
+    Capsule.P = PointToWorldSpace(Capsule.P, T);
+    Capsule.Q = PointToWorldSpace(Capsule.Q, T);
+    return Capsule;
+}
+
+// The narrowphase writes into scratch memory that grows as needed, a body lying on a mesh
+// or heightfield touches as many triangles as it covers.
+struct manifold_buffer
+{
+    contact_manifold *Manifolds;
+    i32 Count;
+    i32 MaxCount;
+};
+
+// Returns the cleared manifold past the last one, it's only kept once the count is bumped.
+contact_manifold *ReserveManifold(manifold_buffer *Buffer)
+{
+    if (Buffer->Count == Buffer->MaxCount)
+    {
+        i32 MaxCount = Max(2 * Buffer->MaxCount, 8);
+        contact_manifold *Manifolds = ArenaPushArray(TemporaryArena(), MaxCount, contact_manifold);
+        memcpy(Manifolds, Buffer->Manifolds, Buffer->Count * sizeof(contact_manifold));
+        Buffer->Manifolds = Manifolds;
+        Buffer->MaxCount = MaxCount;
+    }
+
+    contact_manifold *Result = Buffer->Manifolds + Buffer->Count;
+    memset(Result, 0, sizeof(*Result));
+    return Result;
+}
+
+inline i32 CommitManifolds(manifold_buffer *Buffer, i32 Count)
+{
+    Buffer->Count += Count;
+    return Count;
+}
+
+// Narrowphase functions, the manifold normal always points from A towards B.
+// Appends to the buffer and returns the number of manifolds added, a pair of shapes may
+// touch in several places. The poses are passed separately since the bodies may be
+// temporary sub-shapes.
+typedef i32 collide_function(rigid_body *A, transform TA, rigid_body *B, transform TB, manifold_buffer *Out);
+
+i32 CollideHullHull(rigid_body *A, transform TA, rigid_body *B, transform TB, manifold_buffer *Out)
+{
+    return CommitManifolds(Out, CollideHulls(A->Hull, A->Scale, TA, B->Hull, B->Scale, TB, ReserveManifold(Out)));
+}
+
+i32 CollideSphereSphere(rigid_body *A, transform TA, rigid_body *B, transform TB, manifold_buffer *Out)
+{
+    return CommitManifolds(Out, CollideSpheres(SphereToWorldSpace(A->Sphere, TA),
+                                               SphereToWorldSpace(B->Sphere, TB), ReserveManifold(Out)));
+}
+
+i32 CollideSphereCapsule(rigid_body *A, transform TA, rigid_body *B, transform TB, manifold_buffer *Out)
+{
+    return CommitManifolds(Out, CollideSphereCapsule(SphereToWorldSpace(A->Sphere, TA),
+                                                     CapsuleToWorldSpace(B->Capsule, TB), ReserveManifold(Out)));
+}
+
+i32 CollideCapsuleCapsule(rigid_body *A, transform TA, rigid_body *B, transform TB, manifold_buffer *Out)
+{
+    return CommitManifolds(Out, CollideCapsules(CapsuleToWorldSpace(A->Capsule, TA),
+                                                CapsuleToWorldSpace(B->Capsule, TB), ReserveManifold(Out)));
+}
+
+i32 CollideSphereHull(rigid_body *A, transform TA, rigid_body *B, transform TB, manifold_buffer *Out)
+{
+    return CommitManifolds(Out, CollideSphereHull(SphereToWorldSpace(A->Sphere, TA), B->Hull, B->Scale, TB, ReserveManifold(Out)));
+}
+
+i32 CollideCapsuleHull(rigid_body *A, transform TA, rigid_body *B, transform TB, manifold_buffer *Out)
+{
+    return CommitManifolds(Out, CollideCapsuleHull(CapsuleToWorldSpace(A->Capsule, TA), B->Hull, B->Scale, TB, ReserveManifold(Out)));
+}
+
+// Only one ordering of every shape pair is implemented, the other one is generated
+// at compile time by swapping the bodies and flipping the normal.
+template <collide_function Collide>
+i32 CollideFlipped(rigid_body *A, transform TA, rigid_body *B, transform TB, manifold_buffer *Out)
+{
+    i32 First = Out->Count;
+    i32 Count = Collide(B, TB, A, TA, Out);
+    for (i32 i = First; i < Out->Count; ++i)
+    {
+        contact_manifold *Manifold = Out->Manifolds + i;
+        Manifold->Normal = -Manifold->Normal;
+        i32 Temp = Manifold->SubShapeA;
+        Manifold->SubShapeA = Manifold->SubShapeB;
+        Manifold->SubShapeB = Temp;
+    }
+    return Count;
+}
+
+extern collide_function *CollisionTable[ShapeType_Count][ShapeType_Count];
+
+// A compound child as a standalone hull body, only the shape is set and the rest is zero.
+// It is posed at TransformConcat of the body and child transforms.
+inline rigid_body CompoundChildBody(compound_child *Child)
+{
+    rigid_body Result = {};
+    Result.ShapeType = ShapeType_Hull;
+    Result.Hull = Child->Hull;
+    Result.Scale = Child->Scale;
+    // Child bounds are in compound space, this is loose but only used for culling.
+    transform Identity = {V3(0,0,0), Rotation(V3(1,0,0), 0)};
+    Result.BoundingVolume = TransformAABB(Child->Bounds, RelativeTransform(Child->Transform, Identity));
+    return Result;
+}
+
+i32 CollideCompoundShape(rigid_body *A, transform TA, rigid_body *B, transform TB, manifold_buffer *Out)
+{
+    compound *Compound = A->Compound;
+    aabb Bounds = TransformAABB(B->BoundingVolume, RelativeTransform(TA, TB));
+
+    // Every overlapping child is tested, compounds with many parts query again into the
+    // temporary arena.
+    i32 LocalChildren[32];
+    i32 *Children = LocalChildren;
+    i32 ChildCount = QueryCompound(Compound, Bounds, Children, ARRAY_SIZE(LocalChildren));
+    if (ChildCount > ARRAY_SIZE(LocalChildren))
+    {
+        Children = ArenaPushArray(TemporaryArena(), ChildCount, i32);
+        QueryCompound(Compound, Bounds, Children, ChildCount);
+    }
+
+    i32 First = Out->Count;
+    for (i32 i = 0; i < ChildCount; ++i)
+    {
+        compound_child *Child = Compound->Children + Children[i];
+        rigid_body ChildBody = CompoundChildBody(Child);
+        collide_function *Collide = CollisionTable[ShapeType_Hull][B->ShapeType];
+        i32 ChildFirst = Out->Count;
+        Collide(&ChildBody, TransformConcat(TA, Child->Transform), B, TB, Out);
+        for (i32 j = ChildFirst; j < Out->Count; ++j)
+        {
+            Out->Manifolds[j].SubShapeA = Children[i];
+        }
+    }
+    return Out->Count - First;
+}
+
+// Walks both child trees at once, only descending into pairs of overlapping nodes.
+i32 CollideCompoundCompound(rigid_body *A, transform TA, rigid_body *B, transform TB, manifold_buffer *Out)
+{
+    compound *CompoundA = A->Compound;
+    compound *CompoundB = B->Compound;
+    transform BToA = RelativeTransform(TA, TB);
+
+    i32 First = Out->Count;
+    i32 StackCount = 0;
+    i32 Stack[64][2];
+    Stack[StackCount][0] = 0;
+    Stack[StackCount][1] = 0;
+    StackCount++;
+    while (StackCount > 0)
+    {
+        --StackCount;
+        i32 IndexA = Stack[StackCount][0];
+        i32 IndexB = Stack[StackCount][1];
+        compound_node *NodeA = CompoundA->Nodes + IndexA;
+        compound_node *NodeB = CompoundB->Nodes + IndexB;
+        if (!IntersectAABBAABB(NodeA->Bounds, TransformAABB(NodeB->Bounds, BToA)))
+        {
+            continue;
+        }
+
+        bool LeafA = (NodeA->Child != -1);
+        bool LeafB = (NodeB->Child != -1);
+        if (LeafA && LeafB)
+        {
+            compound_child *ChildA = CompoundA->Children + NodeA->Child;
+            compound_child *ChildB = CompoundB->Children + NodeB->Child;
+            rigid_body BodyA = CompoundChildBody(ChildA);
+            rigid_body BodyB = CompoundChildBody(ChildB);
+            if (CollideHullHull(&BodyA, TransformConcat(TA, ChildA->Transform),
+                                &BodyB, TransformConcat(TB, ChildB->Transform), Out))
+            {
+                contact_manifold *Manifold = Out->Manifolds + Out->Count - 1;
+                Manifold->SubShapeA = NodeA->Child;
+                Manifold->SubShapeB = NodeB->Child;
+            }
+            continue;
+        }
+
+        ASSERT(StackCount + 2 <= ARRAY_SIZE(Stack));
+        // Descend into the larger node, or the only one that isn't a leaf.
+        v3 SizeA = NodeA->Bounds.Max - NodeA->Bounds.Min;
+        v3 SizeB = NodeB->Bounds.Max - NodeB->Bounds.Min;
+        if (LeafB || (!LeafA && Dot(SizeA, SizeA) >= Dot(SizeB, SizeB)))
+        {
+            Stack[StackCount][0] = IndexA + 1;
+            Stack[StackCount][1] = IndexB;
+            StackCount++;
+            Stack[StackCount][0] = NodeA->RightNode;
+            Stack[StackCount][1] = IndexB;
+            StackCount++;
+        }
+        else
+        {
+            Stack[StackCount][0] = IndexA;
+            Stack[StackCount][1] = IndexB + 1;
+            StackCount++;
+            Stack[StackCount][0] = IndexA;
+            Stack[StackCount][1] = NodeB->RightNode;
+            StackCount++;
+        }
+    }
+    return Out->Count - First;
+}
+
+// Triangles of static geometry collide as flat hulls. They are one sided, so triangles
+// with the body's origin behind them are skipped.
+// The manifold is appended to the buffer only if the triangle is touched.
+bool CollideTriangle(rigid_body *A, transform TA, v3 V0, v3 V1, v3 V2, u8 EdgeFlags, transform T, manifold_buffer *Out)
+{
+    if (IsZeroVector(Cross(V1 - V0, V2 - V0)))
+    {
+        return false;
+    }
+
+    triangle_hull Triangle;
+    InitTriangleHull(&Triangle, V0, V1, V2);
+    if (SignedDistance(Triangle.Planes[0], PointToLocalSpace(TA.Position, T)) < 0.f)
+    {
+        return false;
+    }
+
+    rigid_body TriangleBody = {};
+    TriangleBody.ShapeType = ShapeType_Hull;
+    TriangleBody.Hull = &Triangle.Hull;
+    TriangleBody.Scale = V3(1,1,1);
+
+    collide_function *Collide = CollisionTable[A->ShapeType][ShapeType_Hull];
+    i32 First = Out->Count;
+    if (Collide(A, TA, &TriangleBody, T, Out) &&
+        FixInternalEdgeContact(EdgeFlags, &Triangle, T, A, TA, Out->Manifolds + First))
+    {
+        return true;
+    }
+    Out->Count = First;
+    return false;
+}
+
+// One manifold per touching triangle.
+i32 CollideShapeTriangleMesh(rigid_body *A, transform TA, rigid_body *B, transform TB, manifold_buffer *Out)
+{
+    triangle_mesh *Mesh = B->Mesh;
+    aabb Bounds = TransformAABB(A->BoundingVolume, RelativeTransform(TB, TA));
+
+    // Large bodies can overlap more triangles than fit on the stack, those query again
+    // into the temporary arena.
+    i32 LocalTriangles[64];
+    i32 *Triangles = LocalTriangles;
+    i32 TriangleCount = QueryTriangleMesh(Mesh, Bounds, Triangles, ARRAY_SIZE(LocalTriangles));
+    if (TriangleCount > ARRAY_SIZE(LocalTriangles))
+    {
+        Triangles = ArenaPushArray(TemporaryArena(), TriangleCount, i32);
+        QueryTriangleMesh(Mesh, Bounds, Triangles, TriangleCount);
+    }
+
+    i32 First = Out->Count;
+    for (i32 i = 0; i < TriangleCount; ++i)
+    {
+        v3 V0, V1, V2;
+        GetMeshTriangle(Mesh, Triangles[i], &V0, &V1, &V2);
+
+        if (CollideTriangle(A, TA, V0, V1, V2, Mesh->EdgeFlags[Triangles[i]], TB, Out))
+        {
+            contact_manifold *Manifold = Out->Manifolds + Out->Count - 1;
+            Manifold->SubShapeA = 0;
+            Manifold->SubShapeB = Triangles[i];
+        }
+    }
+    return Out->Count - First;
+}
+
+// Only the cells under the body are visited, each cell is split into two triangles.
+i32 CollideShapeHeightfield(rigid_body *A, transform TA, rigid_body *B, transform TB, manifold_buffer *Out)
+{
+    heightfield *Field = B->Heightfield;
+    aabb Bounds = TransformAABB(A->BoundingVolume, RelativeTransform(TB, TA));
+
+    // Same as for triangle meshes, large bodies query again into the temporary arena.
+    i32 LocalCells[32];
+    i32 *Cells = LocalCells;
+    i32 CellCount = QueryHeightfield(Field, Bounds, Cells, ARRAY_SIZE(LocalCells));
+    if (CellCount > ARRAY_SIZE(LocalCells))
+    {
+        Cells = ArenaPushArray(TemporaryArena(), CellCount, i32);
+        QueryHeightfield(Field, Bounds, Cells, CellCount);
+    }
+
+    i32 First = Out->Count;
+    for (i32 i = 0; i < CellCount; ++i)
+    {
+        for (i32 Half = 0; Half < 2; ++Half)
+        {
+            v3 V[3];
+            u8 EdgeFlags = GetHeightfieldTriangle(Field, Cells[i], Half, V);
+
+            if (CollideTriangle(A, TA, V[0], V[1], V[2], EdgeFlags, TB, Out))
+            {
+                contact_manifold *Manifold = Out->Manifolds + Out->Count - 1;
+                Manifold->SubShapeA = 0;
+                Manifold->SubShapeB = 2*Cells[i] + Half;
+            }
+        }
+    }
+    return Out->Count - First;
+}
+
+// Static shapes never touch each other.
+i32 CollideNone(rigid_body *A, transform TA, rigid_body *B, transform TB, manifold_buffer *Out)
+{
+    return 0;
+}
+
+// Indexed by [A->ShapeType][B->ShapeType].
+collide_function *CollisionTable[ShapeType_Count][ShapeType_Count] =
+{
+    // Hull
+    {
+        CollideHullHull,
+        CollideFlipped<CollideSphereHull>,
+        CollideFlipped<CollideCapsuleHull>,
+        CollideFlipped<CollideCompoundShape>,
+        CollideShapeTriangleMesh,
+        CollideShapeHeightfield,
+    },
+    // Sphere
+    {
+        CollideSphereHull,
+        CollideSphereSphere,
+        CollideSphereCapsule,
+        CollideFlipped<CollideCompoundShape>,
+        CollideShapeTriangleMesh,
+        CollideShapeHeightfield,
+    },
+    // Capsule
+    {
+        CollideCapsuleHull,
+        CollideFlipped<CollideSphereCapsule>,
+        CollideCapsuleCapsule,
+        CollideFlipped<CollideCompoundShape>,
+        CollideShapeTriangleMesh,
+        CollideShapeHeightfield,
+    },
+    // Compound
+    {
+        CollideCompoundShape,
+        CollideCompoundShape,
+        CollideCompoundShape,
+        CollideCompoundCompound,
+        CollideCompoundShape,
+        CollideCompoundShape,
+    },
+    // Triangle mesh
+    {
+        CollideFlipped<CollideShapeTriangleMesh>,
+        CollideFlipped<CollideShapeTriangleMesh>,
+        CollideFlipped<CollideShapeTriangleMesh>,
+        CollideFlipped<CollideCompoundShape>,
+        CollideNone,
+        CollideNone,
+    },
+    // Heightfield
+    {
+        CollideFlipped<CollideShapeHeightfield>,
+        CollideFlipped<CollideShapeHeightfield>,
+        CollideFlipped<CollideShapeHeightfield>,
+        CollideFlipped<CollideCompoundShape>,
+        CollideNone,
+        CollideNone,
+    },
+};
+
+// Bodies joined by a joint don't collide, unless the joint asks for it.
+bool JointFiltersPair(world *World, entity_handle A, entity_handle B)
+{
+    for (i32 i = 0; i < World->JointCount; ++i)
+    {
+        joint *Joint = World->Joints + i;
+        if (((Joint->EntityA == A && Joint->EntityB == B) ||
+             (Joint->EntityA == B && Joint->EntityB == A)) &&
+            !Joint->CollideConnected)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Broadphase(world *World)
+{
+    manifold_buffer Manifolds = {};
+
+    // Bodies flagged since the last step get their world bounds now, the pairs below only
+    // read them.
+    for (i32 i = 1; i < World->EntityCount; ++i)
+    {
+        UpdateBodyBounds(i);
+    }
+
+    // O(n^2) broadphase, @TODO: Replace with dynamic "fat" AABB tree
+    for (i32 i = 1; i < World->EntityCount; ++i)
+    {
+        for (i32 j = i+1; j < World->EntityCount; ++j)
+        {
+            rigid_body *A = GetEntityByHandle(i);
+            rigid_body *B = GetEntityByHandle(j);
+            if (A->Type != RigidBodyType_Dynamic && B->Type != RigidBodyType_Dynamic)
+            {
+                continue;
+            }
+
+            // Neither body has moved, keep the contacts of resting pairs alive so the
+            // islands stay connected and the impulses are there when they wake up.
+            bool AwakeA = A->Type == RigidBodyType_Dynamic && !A->IsSleeping;
+            bool AwakeB = B->Type == RigidBodyType_Dynamic && !B->IsSleeping;
+            if (!AwakeA && !AwakeB)
+            {
+                arbiter *Arbiter = GetArbiter(World, i, j);
+                if (Arbiter)
+                {
+                    Arbiter->LastUpdatedStep = World->StepIndex;
+                }
+                continue;
+            }
+
+            // Pairs whose bounds don't overlap can't touch, their arbiter is removed below.
+            if (!IntersectAABBAABB(World->WorldBounds[i], World->WorldBounds[j]))
+            {
+                continue;
+            }
+
+            collide_function *Collide = CollisionTable[A->ShapeType][B->ShapeType];
+            Manifolds.Count = 0;
+            i32 ManifoldCount = Collide(A, World->Poses[i], B, World->Poses[j], &Manifolds);
+            World->DEBUG_SATCalls++;
+
+            // Only touching pairs are checked against the joints, the pool is searched.
+            if (ManifoldCount > 0 && A->JointCount && B->JointCount && JointFiltersPair(World, i, j))
+            {
+                ManifoldCount = 0;
+            }
+
+            if (ManifoldCount > 0)
+            {
+                World->DEBUG_DetectedCollisions++;
+                arbiter *Arbiter = GetArbiter(World, i, j, true);
+                MergeContacts(Arbiter, Manifolds.Manifolds, ManifoldCount);
+                Arbiter->LastUpdatedStep = World->StepIndex;
+            }
+        }
+    }
+
+    // Sweep the live arbiters only, removal moves the last one into the current index.
+    arbiter_table *Table = &World->Arbiters;
+    for (i32 i = 0; i < Table->ArbiterCount;)
+    {
+        arbiter *Arbiter = Table->Arbiters + i;
+        if (Arbiter->LastUpdatedStep != World->StepIndex)
+        {
+            RemoveArbiter(World, Arbiter);
+        }
+        else
+        {
+            ++i;
+        }
+    }
+}
+
+inline i32 FindIsland(i32 *Parents, i32 Body)
+{
+    while (Parents[Body] != Body)
+    {
+        Parents[Body] = Parents[Parents[Body]];
+        Body = Parents[Body];
+    }
+    return Body;
+}
+
+// Union-find over the contacts and joints between dynamic bodies. An island with any awake body in
+// it is woken up completely, so afterwards every island is either awake or asleep.
+void BuildIslands(world *World)
+{
+    i32 *Parents = ArenaPushArray(TemporaryArena(), World->EntityCount, i32);
+    for (i32 i = 0; i < World->EntityCount; ++i)
+    {
+        Parents[i] = i;
+    }
+
+    arbiter_table *Table = &World->Arbiters;
+    for (i32 i = 0; i < Table->ArbiterCount; ++i)
+    {
+        arbiter *Arbiter = Table->Arbiters + i;
+        if (GetEntityByHandle(Arbiter->EntityA)->Type != RigidBodyType_Dynamic ||
+            GetEntityByHandle(Arbiter->EntityB)->Type != RigidBodyType_Dynamic)
+        {
+            continue;
+        }
+
+        i32 RootA = FindIsland(Parents, Arbiter->EntityA);
+        i32 RootB = FindIsland(Parents, Arbiter->EntityB);
+        if (RootA != RootB)
+        {
+            Parents[RootB] = RootA;
+        }
+    }
+
+    for (i32 i = 0; i < World->JointCount; ++i)
+    {
+        joint *Joint = World->Joints + i;
+        if (GetEntityByHandle(Joint->EntityA)->Type != RigidBodyType_Dynamic ||
+            GetEntityByHandle(Joint->EntityB)->Type != RigidBodyType_Dynamic)
+        {
+            continue;
+        }
+
+        i32 RootA = FindIsland(Parents, Joint->EntityA);
+        i32 RootB = FindIsland(Parents, Joint->EntityB);
+        if (RootA != RootB)
+        {
+            Parents[RootB] = RootA;
+        }
+    }
+
+    bool *IslandAwake = ArenaPushArray(TemporaryArena(), World->EntityCount, bool);
+    for (i32 i = 1; i < World->EntityCount; ++i)
+    {
+        Parents[i] = FindIsland(Parents, i);
+        rigid_body *Body = GetEntityByHandle(i);
+        if (Body->Type == RigidBodyType_Dynamic && !Body->IsSleeping)
+        {
+            IslandAwake[Parents[i]] = true;
+        }
+    }
+
+    World->DEBUG_AwakeBodies = 0;
+    for (i32 i = 1; i < World->EntityCount; ++i)
+    {
+        rigid_body *Body = GetEntityByHandle(i);
+        if (Body->Type != RigidBodyType_Dynamic)
+        {
+            continue;
+        }
+
+        if (IslandAwake[Parents[i]])
+        {
+            if (Body->IsSleeping)
+            {
+                WakeBody(i);
+                Body->Recalculate();
+                UpdateBodyBounds(i);
+            }
+            World->DEBUG_AwakeBodies++;
+        }
+    }
+
+    World->BodyIslands = Parents;
+}
+
+// Islands go to sleep once all of their bodies have been slow for long enough.
+void UpdateSleep(world *World, float dt)
+{
+    float LinearSleepVelocity = World->LinearSleepVelocity;
+    float AngularSleepVelocity = World->AngularSleepVelocity;
+    float TimeToSleep = World->TimeToSleep;
+
+    float *IslandSleepTimes = ArenaPushArray(TemporaryArena(), World->EntityCount, float);
+    for (i32 i = 0; i < World->EntityCount; ++i)
+    {
+        IslandSleepTimes[i] = FLT_MAX;
+    }
+
+    for (i32 i = 1; i < World->EntityCount; ++i)
+    {
+        rigid_body *Body = GetEntityByHandle(i);
+        if (Body->Type != RigidBodyType_Dynamic || Body->IsSleeping)
+        {
+            continue;
+        }
+
+        body_motion *Motion = GetBodyMotion(i);
+        if (LengthSquared(Motion->LinearVelocity) > LinearSleepVelocity * LinearSleepVelocity ||
+            LengthSquared(Motion->AngularVelocity) > AngularSleepVelocity * AngularSleepVelocity)
+        {
+            Body->SleepTime = 0.f;
+        }
+        else
+        {
+            Body->SleepTime += dt;
+        }
+
+        i32 Island = World->BodyIslands[i];
+        IslandSleepTimes[Island] = Min(IslandSleepTimes[Island], Body->SleepTime);
+    }
+
+    // A running motor keeps its island awake, however slowly it turns the bodies.
+    for (i32 i = 0; i < World->JointCount; ++i)
+    {
+        joint *Joint = World->Joints + i;
+        if (!Joint->EnableMotor || Joint->MotorSpeed == 0.f)
+        {
+            continue;
+        }
+
+        entity_handle Bodies[2] = {Joint->EntityA, Joint->EntityB};
+        for (i32 j = 0; j < 2; ++j)
+        {
+            rigid_body *Body = GetEntityByHandle(Bodies[j]);
+            if (Body->Type == RigidBodyType_Dynamic && !Body->IsSleeping)
+            {
+                Body->SleepTime = 0.f;
+                IslandSleepTimes[World->BodyIslands[Bodies[j]]] = 0.f;
+            }
+        }
+    }
+
+    for (i32 i = 1; i < World->EntityCount; ++i)
+    {
+        rigid_body *Body = GetEntityByHandle(i);
+        if (Body->Type != RigidBodyType_Dynamic || Body->IsSleeping ||
+            IslandSleepTimes[World->BodyIslands[i]] < TimeToSleep)
+        {
+            continue;
+        }
+
+        Body->IsSleeping = true;
+        Body->LinearMomentum = {};
+        Body->AngularMomentum = {};
+        GetBodyMotion(i)->LinearVelocity = {};
+        GetBodyMotion(i)->AngularVelocity = {};
+    }
+}
+
+inline float EffectiveMass(body_motion *A, body_motion *B, v3 RA, v3 RB, v3 Direction)
+{
+    float Result = A->InverseMass + B->InverseMass;
+    Result += Dot(A->WorldInverseInertia * Cross(Cross(RA, Direction), RA) +
+                  B->WorldInverseInertia * Cross(Cross(RB, Direction), RB),
+                  Direction);
+    return 1.f / Result;
+}
+
+// Pairs up the points of the manifold, 0 with 1 and 2 with 3. The reduced manifold puts
+// the two points furthest apart first, so the pairs are usually well conditioned.
+void PrepareContactBlocks(body_motion *A, body_motion *B, contact_constraint *Constraint)
+{
+    float MaxConditionNumber = 1000.f;
+
+    Constraint->BlockCount = 0;
+    Constraint->BlockedPoints = 0;
+    for (i32 First = 0; First + 1 < Constraint->PointCount; First += 2)
+    {
+        contact_constraint_point *Point1 = Constraint->Points + First;
+        contact_constraint_point *Point2 = Constraint->Points + First + 1;
+        v3 RnA1 = Cross(Point1->RA, Constraint->Normal);
+        v3 RnB1 = Cross(Point1->RB, Constraint->Normal);
+        v3 RnA2 = Cross(Point2->RA, Constraint->Normal);
+        v3 RnB2 = Cross(Point2->RB, Constraint->Normal);
+
+        float InverseMass = A->InverseMass + B->InverseMass;
+        float K11 = 1.f / Point1->NormalMass;
+        float K22 = 1.f / Point2->NormalMass;
+        float K12 = InverseMass +
+            Dot(RnA1, A->WorldInverseInertia * RnA2) +
+            Dot(RnB1, B->WorldInverseInertia * RnB2);
+
+        // Points close together make K nearly singular, those are left to the sequential solver.
+        float Determinant = K11 * K22 - K12 * K12;
+        if (K11 * K11 >= MaxConditionNumber * Determinant)
+        {
+            continue;
+        }
+
+        contact_block *Block = Constraint->Blocks + Constraint->BlockCount++;
+        Block->Points[0] = First;
+        Block->Points[1] = First + 1;
+        Block->K[0] = K11;
+        Block->K[1] = K12;
+        Block->K[2] = K22;
+        float InverseDeterminant = 1.f / Determinant;
+        Block->InverseK[0] = K22 * InverseDeterminant;
+        Block->InverseK[1] = -K12 * InverseDeterminant;
+        Block->InverseK[2] = K11 * InverseDeterminant;
+        Constraint->BlockedPoints |= 3u << First;
+    }
+}
+
+inline void ApplyContactImpulse(body_motion *A, body_motion *B, v3 RA, v3 RB, v3 P)
+{
+    if (A->InverseMass > 0.f)
+    {
+        A->LinearVelocity -= A->InverseMass * P;
+        A->AngularVelocity -= A->WorldInverseInertia * Cross(RA, P);
+    }
+
+    if (B->InverseMass > 0.f)
+    {
+        B->LinearVelocity += B->InverseMass * P;
+        B->AngularVelocity += B->WorldInverseInertia * Cross(RB, P);
+    }
+}
+
+inline void ApplyTwistImpulse(body_motion *A, body_motion *B, v3 L)
+{
+    if (A->InverseMass > 0.f)
+    {
+        A->AngularVelocity -= A->WorldInverseInertia * L;
+    }
+
+    if (B->InverseMass > 0.f)
+    {
+        B->AngularVelocity += B->WorldInverseInertia * L;
+    }
+}
+
+// Versions for the velocity solver, specialized on which body is static. Static bodies
+// never move, so their velocity terms and writes are left out entirely, and the other
+// bodies are known to be dynamic without checking.
+template <bool StaticA, bool StaticB>
+inline v3 ContactVelocity(body_motion *A, body_motion *B, v3 RA, v3 RB)
+{
+    v3 Result = V3(0, 0, 0);
+    if (!StaticB)
+    {
+        Result += B->LinearVelocity + Cross(B->AngularVelocity, RB);
+    }
+    if (!StaticA)
+    {
+        Result -= A->LinearVelocity + Cross(A->AngularVelocity, RA);
+    }
+    return Result;
+}
+
+template <bool StaticA, bool StaticB>
+inline void ApplyContactImpulse(body_motion *A, body_motion *B, v3 RA, v3 RB, v3 P)
+{
+    if (!StaticA)
+    {
+        A->LinearVelocity -= A->InverseMass * P;
+        A->AngularVelocity -= A->WorldInverseInertia * Cross(RA, P);
+    }
+
+    if (!StaticB)
+    {
+        B->LinearVelocity += B->InverseMass * P;
+        B->AngularVelocity += B->WorldInverseInertia * Cross(RB, P);
+    }
+}
+
+template <bool StaticA, bool StaticB>
+inline void ApplyTwistImpulse(body_motion *A, body_motion *B, v3 L)
+{
+    if (!StaticA)
+    {
+        A->AngularVelocity -= A->WorldInverseInertia * L;
+    }
+
+    if (!StaticB)
+    {
+        B->AngularVelocity += B->WorldInverseInertia * L;
+    }
+}
+
+void PreparePatchFriction(world *World, body_motion *A, body_motion *B, v3 CA, v3 CB, contact_constraint *Constraint)
+{
+    contact_manifold *Manifold = Constraint->Manifold;
+    v3 Center = V3(0, 0, 0);
+    for (i32 i = 0; i < Manifold->PointCount; ++i)
+    {
+        Center += Manifold->Points[i].Position;
+    }
+    Center = Center * (1.f / Manifold->PointCount);
+
+    float Radius = 0.f;
+    for (i32 i = 0; i < Manifold->PointCount; ++i)
+    {
+        Radius += Length(Manifold->Points[i].Position - Center);
+    }
+    Constraint->FrictionRadius = Radius / Manifold->PointCount;
+
+    Constraint->PatchRA = Center - CA;
+    Constraint->PatchRB = Center - CB;
+    for (i32 k = 0; k < 2; ++k)
+    {
+        Constraint->PatchTangentMass[k] = EffectiveMass(A, B, Constraint->PatchRA, Constraint->PatchRB, Constraint->Tangent[k]);
+    }
+
+    v3 Normal = Constraint->Normal;
+    float K = Dot(A->WorldInverseInertia * Normal + B->WorldInverseInertia * Normal, Normal);
+    Constraint->TwistMass = K > 0.f ? 1.f / K : 0.f;
+
+    Constraint->PatchImpulse[0] = Manifold->PatchImpulse[0] * World->WarmStartFactor;
+    Constraint->PatchImpulse[1] = Manifold->PatchImpulse[1] * World->WarmStartFactor;
+    Constraint->TwistImpulse = Manifold->TwistImpulse * World->WarmStartFactor;
+
+    // The points only carry the normal impulses.
+    for (i32 i = 0; i < Constraint->PointCount; ++i)
+    {
+        Constraint->Points[i].TangentImpulse[0] = 0.f;
+        Constraint->Points[i].TangentImpulse[1] = 0.f;
+    }
+}
+
+void WarmStartPatchFriction(body_motion *A, body_motion *B, contact_constraint *Constraint)
+{
+    v3 P =
+        Constraint->PatchImpulse[0] * Constraint->Tangent[0] +
+        Constraint->PatchImpulse[1] * Constraint->Tangent[1];
+    ApplyContactImpulse(A, B, Constraint->PatchRA, Constraint->PatchRB, P);
+    ApplyTwistImpulse(A, B, Constraint->TwistImpulse * Constraint->Normal);
+}
+
+// The friction impulse is clamped to a circle instead of a box, and the twist to the
+// friction radius times the total normal impulse. Returns the residual like
+// SolveContactConstraint, the twist at the friction radius.
+template <bool StaticA, bool StaticB>
+float SolvePatchFriction(body_motion *A, body_motion *B, contact_constraint *Constraint)
+{
+    float Residual = 0.f;
+    float NormalImpulse = 0.f;
+    for (i32 i = 0; i < Constraint->PointCount; ++i)
+    {
+        NormalImpulse += Constraint->Points[i].NormalImpulse;
+    }
+    float MaxImpulse = Constraint->Friction * NormalImpulse;
+
+    v3 RA = Constraint->PatchRA;
+    v3 RB = Constraint->PatchRB;
+    v3 RelativeVelocity = ContactVelocity<StaticA, StaticB>(A, B, RA, RB);
+
+    float Impulse0[2] = {Constraint->PatchImpulse[0], Constraint->PatchImpulse[1]};
+    for (i32 k = 0; k < 2; ++k)
+    {
+        float Vt = Dot(RelativeVelocity, Constraint->Tangent[k]);
+        Constraint->PatchImpulse[k] = Impulse0[k] - Constraint->PatchTangentMass[k] * Vt;
+    }
+
+    float ImpulseLength = sqrtf(Square(Constraint->PatchImpulse[0]) + Square(Constraint->PatchImpulse[1]));
+    if (ImpulseLength > MaxImpulse)
+    {
+        float Scale = MaxImpulse / ImpulseLength;
+        Constraint->PatchImpulse[0] *= Scale;
+        Constraint->PatchImpulse[1] *= Scale;
+    }
+
+    float Delta0 = Constraint->PatchImpulse[0] - Impulse0[0];
+    float Delta1 = Constraint->PatchImpulse[1] - Impulse0[1];
+    ApplyContactImpulse<StaticA, StaticB>(A, B, RA, RB, Delta0 * Constraint->Tangent[0] + Delta1 * Constraint->Tangent[1]);
+    Residual = Max(Residual, fabsf(Delta0) / Constraint->PatchTangentMass[0]);
+    Residual = Max(Residual, fabsf(Delta1) / Constraint->PatchTangentMass[1]);
+
+    if (Constraint->TwistMass > 0.f)
+    {
+        float MaxTwist = Constraint->FrictionRadius * MaxImpulse;
+        float Wn = 0.f;
+        if (!StaticB) Wn += Dot(B->AngularVelocity, Constraint->Normal);
+        if (!StaticA) Wn -= Dot(A->AngularVelocity, Constraint->Normal);
+        float TwistImpulse0 = Constraint->TwistImpulse;
+        Constraint->TwistImpulse = Clamp(TwistImpulse0 - Constraint->TwistMass * Wn, -MaxTwist, MaxTwist);
+        float TwistImpulse = Constraint->TwistImpulse - TwistImpulse0;
+        ApplyTwistImpulse<StaticA, StaticB>(A, B, TwistImpulse * Constraint->Normal);
+        Residual = Max(Residual, fabsf(TwistImpulse) / Constraint->TwistMass * Constraint->FrictionRadius);
+    }
+
+    return Residual;
+}
+
+float SolvePatchFriction(body_motion *A, body_motion *B, contact_constraint *Constraint)
+{
+    switch (Constraint->Kind)
+    {
+        case ContactKind_StaticA: return SolvePatchFriction<true, false>(A, B, Constraint);
+        case ContactKind_StaticB: return SolvePatchFriction<false, true>(A, B, Constraint);
+        default: return SolvePatchFriction<false, false>(A, B, Constraint);
+    }
+}
+
+// Builds the constraints of this step from the live arbiters, the impulses accumulated
+// in the previous step are carried over.
+void PrepareContactConstraints(world *World, float dt)
+{
+    float Friction = 0.5f;
+    // Resting contacts keep a little penetration, otherwise they touch and separate
+    // every other step and the warm started impulses are thrown away.
+    float Slop = 0.5f;
+    float BiasFactor = 0.2f;
+    float inv_dt = 1.f / dt;
+
+    arbiter_table *Table = &World->Arbiters;
+    i32 MaxConstraints = 0;
+    for (i32 i = 0; i < Table->ArbiterCount; ++i)
+    {
+        MaxConstraints += Table->Arbiters[i].ManifoldCount;
+    }
+
+    contact_constraint *Constraints = ArenaPushArrayAligned(TemporaryArena(), MaxConstraints, contact_constraint);
+    i32 ConstraintCount = 0;
+    for (i32 ArbiterIndex = 0; ArbiterIndex < Table->ArbiterCount; ++ArbiterIndex)
+    {
+        arbiter *Arbiter = Table->Arbiters + ArbiterIndex;
+        rigid_body *A = GetEntityByHandle(Arbiter->EntityA);
+        rigid_body *B = GetEntityByHandle(Arbiter->EntityB);
+        body_motion *MotionA = GetBodyMotion(Arbiter->EntityA);
+        body_motion *MotionB = GetBodyMotion(Arbiter->EntityB);
+        // Islands are woken as a whole, so the other body is asleep or static too.
+        if (A->IsSleeping || B->IsSleeping)
+        {
+            continue;
+        }
+
+        v3 CA = CenterOfMass(Arbiter->EntityA);
+        v3 CB = CenterOfMass(Arbiter->EntityB);
+
+        for (i32 ManifoldIndex = 0; ManifoldIndex < Arbiter->ManifoldCount; ++ManifoldIndex)
+        {
+            contact_manifold *Manifold = GetArbiterManifold(Arbiter, ManifoldIndex);
+            if (Manifold->PointCount == 0)
+            {
+                continue;
+            }
+
+            contact_constraint *Constraint = Constraints + ConstraintCount++;
+            Constraint->EntityA = Arbiter->EntityA;
+            Constraint->EntityB = Arbiter->EntityB;
+            Constraint->Kind =
+                A->Type != RigidBodyType_Dynamic ? ContactKind_StaticA :
+                B->Type != RigidBodyType_Dynamic ? ContactKind_StaticB : ContactKind_Dynamic;
+            Constraint->Normal = Normalized(Manifold->Normal);
+            Constraint->Tangent[0] = Manifold->Tangent[0];
+            Constraint->Tangent[1] = Manifold->Tangent[1];
+            Constraint->Friction = Friction;
+            Constraint->PointCount = Manifold->PointCount;
+            Constraint->Manifold = Manifold;
+
+            for (i32 i = 0; i < Manifold->PointCount; ++i)
+            {
+                contact_point *Contact = Manifold->Points + i;
+                contact_constraint_point *Point = Constraint->Points + i;
+                Point->RA = Contact->Position - CA;
+                Point->RB = Contact->Position - CB;
+                Point->NormalMass = EffectiveMass(MotionA, MotionB, Point->RA, Point->RB, Constraint->Normal);
+                Point->TangentMass[0] = EffectiveMass(MotionA, MotionB, Point->RA, Point->RB, Constraint->Tangent[0]);
+                Point->TangentMass[1] = EffectiveMass(MotionA, MotionB, Point->RA, Point->RB, Constraint->Tangent[1]);
+                float Bias = -BiasFactor * inv_dt * Min(0.0f, Contact->Penetration + Slop);
+                Point->Bias = World->UseSplitImpulse ? 0.f : Bias;
+                Point->PositionBias = World->UseSplitImpulse ? Bias : 0.f;
+                Point->BiasImpulse = 0.f;
+                Point->Penetration = Contact->Penetration;
+
+                Point->NormalImpulse = Contact->NormalImpulse * World->WarmStartFactor;
+                Point->TangentImpulse[0] = Contact->FrictionImpulse * World->WarmStartFactor;
+                Point->TangentImpulse[1] = Contact->TangentImpulse * World->WarmStartFactor;
+            }
+
+            Constraint->UsePatchFriction = World->UsePatchFriction;
+            Constraint->PatchImpulse[0] = 0.f;
+            Constraint->PatchImpulse[1] = 0.f;
+            Constraint->TwistImpulse = 0.f;
+            if (World->UsePatchFriction)
+            {
+                PreparePatchFriction(World, MotionA, MotionB, CA, CB, Constraint);
+            }
+
+            Constraint->BlockCount = 0;
+            Constraint->BlockedPoints = 0;
+            if (World->UseBlockSolver)
+            {
+                PrepareContactBlocks(MotionA, MotionB, Constraint);
+            }
+        }
+    }
+
+    World->ContactConstraints = Constraints;
+    World->ContactConstraintCount = ConstraintCount;
+}
+
+// Applies the impulses carried over from the last step before the first iteration, so
+// the solver starts close to the solution of a resting contact.
+void WarmStartContactConstraints(world *World)
+{
+    for (i32 ConstraintIndex = 0; ConstraintIndex < World->ContactConstraintCount; ++ConstraintIndex)
+    {
+        contact_constraint *Constraint = World->ContactConstraints + ConstraintIndex;
+        body_motion *A = GetBodyMotion(Constraint->EntityA);
+        body_motion *B = GetBodyMotion(Constraint->EntityB);
+        for (i32 i = 0; i < Constraint->PointCount; ++i)
+        {
+            contact_constraint_point *Point = Constraint->Points + i;
+            v3 P =
+                Point->NormalImpulse * Constraint->Normal +
+                Point->TangentImpulse[0] * Constraint->Tangent[0] +
+                Point->TangentImpulse[1] * Constraint->Tangent[1];
+            ApplyContactImpulse(A, B, Point->RA, Point->RB, P);
+        }
+
+        if (Constraint->UsePatchFriction)
+        {
+            WarmStartPatchFriction(A, B, Constraint);
+        }
+    }
+}
+
+// Solves the normal impulses of both points of the block at once, by trying each
+// combination of active points until one satisfies the complementarity conditions. This
+// is the exact solution for the pair, where sequential impulses only get closer to it
+// with every iteration. Returns false if no combination fits.
+template <bool StaticA, bool StaticB>
+bool SolveContactBlock(body_motion *A, body_motion *B, contact_constraint *Constraint, contact_block *Block, float *Residual)
+{
+    contact_constraint_point *Point1 = Constraint->Points + Block->Points[0];
+    contact_constraint_point *Point2 = Constraint->Points + Block->Points[1];
+    float K11 = Block->K[0];
+    float K12 = Block->K[1];
+    float K22 = Block->K[2];
+
+    v3 RelativeVelocity1 = ContactVelocity<StaticA, StaticB>(A, B, Point1->RA, Point1->RB);
+    v3 RelativeVelocity2 = ContactVelocity<StaticA, StaticB>(A, B, Point2->RA, Point2->RB);
+
+    // Velocities the points would have without the accumulated impulses a, the new
+    // impulses x have to satisfy vn = K * x + b >= 0, x >= 0 and vn * x = 0.
+    float a1 = Point1->NormalImpulse;
+    float a2 = Point2->NormalImpulse;
+    float b1 = Dot(RelativeVelocity1, Constraint->Normal) - Point1->Bias - (K11 * a1 + K12 * a2);
+    float b2 = Dot(RelativeVelocity2, Constraint->Normal) - Point2->Bias - (K12 * a1 + K22 * a2);
+
+    float x1, x2;
+    for (;;)
+    {
+        // Both points touching, vn = 0.
+        x1 = -(Block->InverseK[0] * b1 + Block->InverseK[1] * b2);
+        x2 = -(Block->InverseK[1] * b1 + Block->InverseK[2] * b2);
+        if (x1 >= 0.f && x2 >= 0.f)
+        {
+            break;
+        }
+
+        // Only the first one touching.
+        x1 = -b1 / K11;
+        x2 = 0.f;
+        if (x1 >= 0.f && K12 * x1 + b2 >= 0.f)
+        {
+            break;
+        }
+
+        // Only the second one touching.
+        x1 = 0.f;
+        x2 = -b2 / K22;
+        if (x2 >= 0.f && K12 * x2 + b1 >= 0.f)
+        {
+            break;
+        }
+
+        // Both separating.
+        x1 = 0.f;
+        x2 = 0.f;
+        if (b1 >= 0.f && b2 >= 0.f)
+        {
+            break;
+        }
+
+        return false;
+    }
+
+    ApplyContactImpulse<StaticA, StaticB>(A, B, Point1->RA, Point1->RB, (x1 - a1) * Constraint->Normal);
+    ApplyContactImpulse<StaticA, StaticB>(A, B, Point2->RA, Point2->RB, (x2 - a2) * Constraint->Normal);
+    Point1->NormalImpulse = x1;
+    Point2->NormalImpulse = x2;
+    *Residual = Max(*Residual, Max(fabsf(x1 - a1) * K11, fabsf(x2 - a2) * K22));
+    return true;
+}
+
+// Returns the residual, the largest velocity change of any point along any of its
+// directions.
+template <bool StaticA, bool StaticB>
+float SolveContactConstraint(contact_constraint *Constraint)
+{
+    body_motion *A = GetBodyMotion(Constraint->EntityA);
+    body_motion *B = GetBodyMotion(Constraint->EntityB);
+    float Residual = 0.f;
+
+    u32 BlockedPoints = Constraint->BlockedPoints;
+    for (i32 BlockIndex = 0; BlockIndex < Constraint->BlockCount; ++BlockIndex)
+    {
+        contact_block *Block = Constraint->Blocks + BlockIndex;
+        if (!SolveContactBlock<StaticA, StaticB>(A, B, Constraint, Block, &Residual))
+        {
+            // Numerical trouble, the points are solved one by one below instead.
+            BlockedPoints &= ~(3u << Block->Points[0]);
+        }
+    }
+
+    for (i32 i = 0; i < Constraint->PointCount; ++i)
+    {
+        contact_constraint_point *Point = Constraint->Points + i;
+        v3 RA = Point->RA;
+        v3 RB = Point->RB;
+
+        if (!(BlockedPoints & (1u << i)))
+        {
+            v3 RelativeVelocity = ContactVelocity<StaticA, StaticB>(A, B, RA, RB);
+
+            float Vn = Dot(RelativeVelocity, Constraint->Normal);
+            float NormalImpulse = Point->NormalMass * (-Vn + Point->Bias);
+            float NormalImpulse0 = Point->NormalImpulse;
+            Point->NormalImpulse = Max(NormalImpulse + NormalImpulse0, 0.0f);
+            NormalImpulse = Point->NormalImpulse - NormalImpulse0;
+            ApplyContactImpulse<StaticA, StaticB>(A, B, RA, RB, NormalImpulse * Constraint->Normal);
+            Residual = Max(Residual, fabsf(NormalImpulse) / Point->NormalMass);
+        }
+
+        if (Constraint->UsePatchFriction)
+        {
+            continue;
+        }
+
+        float ImpulseClamp = Constraint->Friction * Point->NormalImpulse;
+        for (i32 k = 0; k < 2; ++k)
+        {
+            v3 RelativeVelocity = ContactVelocity<StaticA, StaticB>(A, B, RA, RB);
+
+            float Vt = Dot(RelativeVelocity, Constraint->Tangent[k]);
+            float TangentImpulse = Point->TangentMass[k] * (-Vt);
+            float TangentImpulse0 = Point->TangentImpulse[k];
+            Point->TangentImpulse[k] = Clamp(TangentImpulse0 + TangentImpulse, -ImpulseClamp, ImpulseClamp);
+            TangentImpulse = Point->TangentImpulse[k] - TangentImpulse0;
+            ApplyContactImpulse<StaticA, StaticB>(A, B, RA, RB, TangentImpulse * Constraint->Tangent[k]);
+            Residual = Max(Residual, fabsf(TangentImpulse) / Point->TangentMass[k]);
+        }
+    }
+
+    if (Constraint->UsePatchFriction)
+    {
+        Residual = Max(Residual, SolvePatchFriction<StaticA, StaticB>(A, B, Constraint));
+    }
+
+    return Residual;
+}
+
+float SolveContactConstraint(contact_constraint *Constraint)
+{
+    switch (Constraint->Kind)
+    {
+        case ContactKind_StaticA: return SolveContactConstraint<true, false>(Constraint);
+        case ContactKind_StaticB: return SolveContactConstraint<false, true>(Constraint);
+        default: return SolveContactConstraint<false, false>(Constraint);
+    }
+}
+
+// Spring and damper of a soft constraint turned into the terms of the velocity solve,
+// see Catto's Solver2D.
+struct contact_softness
+{
+    float BiasRate;
+    float MassScale;
+    float ImpulseScale;
+};
+
+inline contact_softness ContactSoftness(float Hertz, float DampingRatio, float h)
+{
+    float Omega = 2.f * (float)M_PI * Hertz;
+    float A1 = 2.f * DampingRatio + h * Omega;
+    float A2 = h * Omega * A1;
+    float A3 = 1.f / (1.f + A2);
+
+    contact_softness Result;
+    Result.BiasRate = Omega / A1;
+    Result.MassScale = A2 * A3;
+    Result.ImpulseScale = A3;
+    return Result;
+}
+
+// Rotation of B relative to A that is left over after taking out the reference rotation,
+// in the local space of A.
+inline quaternion JointRotationError(quaternion RotationA, quaternion RotationB, joint *Joint)
+{
+    quaternion Result = Conjugate(RotationA) * RotationB * Conjugate(Joint->ReferenceRotation);
+    if (Result.w < 0.f)
+    {
+        Result.w = -Result.w;
+        Result.v = -Result.v;
+    }
+    return Result;
+}
+
+// Feeds the position errors at the current poses back through the velocity bias. The
+// soft step calls this after every sub-step with the lever arms and axes of the step.
+void UpdateJointBias(joint_constraint *Constraint, float inv_dt)
+{
+    joint *Joint = Constraint->Joint;
+    transform PoseA = GetBodyPose(Constraint->EntityA);
+    transform PoseB = GetBodyPose(Constraint->EntityB);
+    float BiasRate = Constraint->BiasRate;
+    v3 AnchorA = PointToWorldSpace(Joint->LocalAnchorA, PoseA);
+    v3 AnchorB = PointToWorldSpace(Joint->LocalAnchorB, PoseB);
+
+    if (Joint->Type == JointType_Distance)
+    {
+        Constraint->AxialBias = BiasRate * (Length(AnchorB - AnchorA) - Joint->Length);
+        return;
+    }
+
+    Constraint->LinearBias = BiasRate * (AnchorB - AnchorA);
+    if (Joint->Type == JointType_Fixed)
+    {
+        quaternion Error = JointRotationError(PoseA.Rotation, PoseB.Rotation, Joint);
+        Constraint->AngularBias = BiasRate * 2.f * RotateVector(Error.v, PoseA.Rotation);
+    }
+    else if (Joint->Type == JointType_Hinge)
+    {
+        v3 AxisA = RotateVector(Joint->LocalAxisA, PoseA.Rotation);
+        v3 AxisB = RotateVector(Joint->LocalAxisB, PoseB.Rotation);
+        v3 Error = Cross(AxisA, AxisB);
+        v3 *P = Constraint->Perpendicular;
+        Constraint->AngularBias = V3(BiasRate * Dot(P[0], Error), BiasRate * Dot(P[1], Error), 0.f);
+
+        // Limits are speculative, an open limit only stops the hinge from closing it
+        // within this step. Only a violated limit is soft.
+        if (Joint->EnableLimit)
+        {
+            quaternion Rotation = JointRotationError(PoseA.Rotation, PoseB.Rotation, Joint);
+            float Angle = 2.f * atan2f(Dot(Rotation.v, Joint->LocalAxisA), Rotation.w);
+            float Lower = Angle - Joint->LowerAngle;
+            float Upper = Joint->UpperAngle - Angle;
+            Constraint->LowerBias = Lower > 0.f ? Lower * inv_dt : BiasRate * Lower;
+            Constraint->UpperBias = Upper > 0.f ? Upper * inv_dt : BiasRate * Upper;
+        }
+    }
+}
+
+// Builds the constraints of this step from the joints between awake bodies. Position
+// errors are fed back through the velocity bias, also with split impulses. The joints are
+// slightly soft, with a plain Baumgarte bias the warm started impulses of a long chain
+// that hasn't converged swing back and forth and grow every step. The soft step passes
+// the sub-step here, the joints are solved once per sub-step.
+void PrepareJointConstraints(world *World, float dt)
+{
+    float JointHertz = 60.f;
+    float JointDampingRatio = 10.f;
+    float inv_dt = 1.f / dt;
+    contact_softness Softness = ContactSoftness(Min(JointHertz, 0.25f * inv_dt), JointDampingRatio, dt);
+
+    joint_constraint *Constraints = ArenaPushArrayAligned(TemporaryArena(), World->JointCount, joint_constraint);
+    i32 ConstraintCount = 0;
+    for (i32 JointIndex = 0; JointIndex < World->JointCount; ++JointIndex)
+    {
+        joint *Joint = World->Joints + JointIndex;
+        rigid_body *A = GetEntityByHandle(Joint->EntityA);
+        rigid_body *B = GetEntityByHandle(Joint->EntityB);
+        body_motion *MotionA = GetBodyMotion(Joint->EntityA);
+        body_motion *MotionB = GetBodyMotion(Joint->EntityB);
+        if (A->IsSleeping || B->IsSleeping ||
+            (A->Type != RigidBodyType_Dynamic && B->Type != RigidBodyType_Dynamic))
+        {
+            continue;
+        }
+
+        joint_constraint *Constraint = Constraints + ConstraintCount++;
+        *Constraint = {};
+        Constraint->Type = Joint->Type;
+        Constraint->EntityA = Joint->EntityA;
+        Constraint->EntityB = Joint->EntityB;
+        Constraint->Joint = Joint;
+        Constraint->MassScale = Softness.MassScale;
+        Constraint->ImpulseScale = Softness.ImpulseScale;
+        Constraint->BiasRate = Softness.BiasRate;
+
+        transform PoseA = GetBodyPose(Joint->EntityA);
+        transform PoseB = GetBodyPose(Joint->EntityB);
+        v3 AnchorA = PointToWorldSpace(Joint->LocalAnchorA, PoseA);
+        v3 AnchorB = PointToWorldSpace(Joint->LocalAnchorB, PoseB);
+        Constraint->RA = AnchorA - CenterOfMass(Joint->EntityA);
+        Constraint->RB = AnchorB - CenterOfMass(Joint->EntityB);
+
+        float Warm = World->WarmStartFactor;
+        Constraint->LinearImpulse = Joint->LinearImpulse * Warm;
+        Constraint->AngularImpulse = Joint->AngularImpulse * Warm;
+        Constraint->AxialImpulse = Joint->AxialImpulse * Warm;
+        Constraint->MotorImpulse = Joint->MotorImpulse * Warm;
+        Constraint->LowerImpulse = Joint->LowerImpulse * Warm;
+        Constraint->UpperImpulse = Joint->UpperImpulse * Warm;
+
+        if (Joint->Type == JointType_Distance)
+        {
+            v3 Delta = AnchorB - AnchorA;
+            float Distance = Length(Delta);
+            Constraint->Axis = Distance > ML_EPSILON ? Delta * (1.f / Distance) : V3(0, 0, 1);
+            Constraint->AxialMass = EffectiveMass(MotionA, MotionB, Constraint->RA, Constraint->RB, Constraint->Axis);
+            UpdateJointBias(Constraint, inv_dt);
+            continue;
+        }
+
+        // Every other joint keeps the anchors together.
+        m3x3 SkewA = CrossProductMatrix(Constraint->RA);
+        m3x3 SkewB = CrossProductMatrix(Constraint->RB);
+        m3x3 K =
+            (MotionA->InverseMass + MotionB->InverseMass) * IdentityMatrix3() -
+            SkewA * MotionA->WorldInverseInertia * SkewA -
+            SkewB * MotionB->WorldInverseInertia * SkewB;
+        Constraint->LinearMass = Inverse(K);
+
+        m3x3 AngularK = MotionA->WorldInverseInertia + MotionB->WorldInverseInertia;
+        if (Joint->Type == JointType_Fixed)
+        {
+            Constraint->AngularMass = Inverse(AngularK);
+        }
+        else if (Joint->Type == JointType_Hinge)
+        {
+            v3 AxisA = RotateVector(Joint->LocalAxisA, PoseA.Rotation);
+            Constraint->Axis = AxisA;
+            ComputeTangentBasis(AxisA, &Constraint->Perpendicular[0], &Constraint->Perpendicular[1]);
+
+            // Only the two directions perpendicular to the axis are locked, the 2x2 inverse
+            // goes into the top left of the angular mass.
+            v3 *P = Constraint->Perpendicular;
+            float K11 = Dot(P[0], AngularK * P[0]);
+            float K12 = Dot(P[0], AngularK * P[1]);
+            float K22 = Dot(P[1], AngularK * P[1]);
+            float Determinant = K11 * K22 - K12 * K12;
+            float InverseDeterminant = Determinant != 0.f ? 1.f / Determinant : 0.f;
+            Constraint->AngularMass[0][0] = K22 * InverseDeterminant;
+            Constraint->AngularMass[0][1] = -K12 * InverseDeterminant;
+            Constraint->AngularMass[1][0] = -K12 * InverseDeterminant;
+            Constraint->AngularMass[1][1] = K11 * InverseDeterminant;
+
+            float AxialK = Dot(AxisA, AngularK * AxisA);
+            Constraint->AxialMass = AxialK > 0.f ? 1.f / AxialK : 0.f;
+
+            Constraint->EnableMotor = Joint->EnableMotor;
+            Constraint->MotorSpeed = Joint->MotorSpeed;
+            Constraint->MaxMotorImpulse = Joint->MaxMotorTorque * dt;
+
+            Constraint->EnableLimit = Joint->EnableLimit;
+            if (!Joint->EnableLimit)
+            {
+                Constraint->LowerImpulse = 0.f;
+                Constraint->UpperImpulse = 0.f;
+            }
+            if (!Joint->EnableMotor)
+            {
+                Constraint->MotorImpulse = 0.f;
+            }
+        }
+        UpdateJointBias(Constraint, inv_dt);
+    }
+
+    World->JointConstraints = Constraints;
+    World->JointConstraintCount = ConstraintCount;
+}
+
+void WarmStartJointConstraint(joint_constraint *Constraint)
+{
+    body_motion *A = GetBodyMotion(Constraint->EntityA);
+    body_motion *B = GetBodyMotion(Constraint->EntityB);
+    if (Constraint->Type == JointType_Distance)
+    {
+        ApplyContactImpulse(A, B, Constraint->RA, Constraint->RB, Constraint->AxialImpulse * Constraint->Axis);
+        return;
+    }
+
+    ApplyContactImpulse(A, B, Constraint->RA, Constraint->RB, Constraint->LinearImpulse);
+    v3 L = Constraint->AngularImpulse;
+    if (Constraint->Type == JointType_Hinge)
+    {
+        float AxialImpulse = Constraint->MotorImpulse + Constraint->LowerImpulse - Constraint->UpperImpulse;
+        L = Constraint->AngularImpulse.x * Constraint->Perpendicular[0] +
+            Constraint->AngularImpulse.y * Constraint->Perpendicular[1] +
+            AxialImpulse * Constraint->Axis;
+    }
+    ApplyTwistImpulse(A, B, L);
+}
+
+void WarmStartJointConstraints(world *World)
+{
+    for (i32 i = 0; i < World->JointConstraintCount; ++i)
+    {
+        WarmStartJointConstraint(World->JointConstraints + i);
+    }
+}
+
+inline v3 RelativeAngularVelocity(body_motion *A, body_motion *B)
+{
+    return B->AngularVelocity - A->AngularVelocity;
+}
+
+// Returns the residual like SolveContactConstraint, angular rows count in rad/s. The
+// anchors are solved last so they hold best. Without UseBias the position errors are
+// ignored and the rows are rigid, for the relax pass of the soft step.
+float SolveJointConstraint(joint_constraint *Constraint, bool UseBias = true)
+{
+    float BiasScale = UseBias ? 1.f : 0.f;
+    float MassScale = UseBias ? Constraint->MassScale : 1.f;
+    float ImpulseScale = UseBias ? Constraint->ImpulseScale : 0.f;
+    body_motion *A = GetBodyMotion(Constraint->EntityA);
+    body_motion *B = GetBodyMotion(Constraint->EntityB);
+    v3 RA = Constraint->RA;
+    v3 RB = Constraint->RB;
+    float Residual = 0.f;
+
+    if (Constraint->Type == JointType_Distance)
+    {
+        v3 RelativeVelocity =
+            B->LinearVelocity + Cross(B->AngularVelocity, RB) -
+            A->LinearVelocity - Cross(A->AngularVelocity, RA);
+        float Cdot = Dot(RelativeVelocity, Constraint->Axis) + BiasScale * Constraint->AxialBias;
+        float Impulse = -MassScale * Constraint->AxialMass * Cdot - ImpulseScale * Constraint->AxialImpulse;
+        Constraint->AxialImpulse += Impulse;
+        ApplyContactImpulse(A, B, RA, RB, Impulse * Constraint->Axis);
+        return fabsf(Cdot);
+    }
+
+    if (Constraint->Type == JointType_Hinge)
+    {
+        v3 Axis = Constraint->Axis;
+        if (Constraint->EnableMotor)
+        {
+            float Cdot = Dot(RelativeAngularVelocity(A, B), Axis) - Constraint->MotorSpeed;
+            float Impulse0 = Constraint->MotorImpulse;
+            Constraint->MotorImpulse = Clamp(Impulse0 - Constraint->AxialMass * Cdot,
+                                             -Constraint->MaxMotorImpulse, Constraint->MaxMotorImpulse);
+            float Impulse = Constraint->MotorImpulse - Impulse0;
+            ApplyTwistImpulse(A, B, Impulse * Axis);
+            Residual = Max(Residual, fabsf(Impulse) * (Constraint->AxialMass > 0.f ? 1.f / Constraint->AxialMass : 0.f));
+        }
+
+        if (Constraint->EnableLimit)
+        {
+            // Lower limit pushes along the axis, the upper one against it.
+            for (i32 Side = 0; Side < 2; ++Side)
+            {
+                float Sign = Side == 0 ? 1.f : -1.f;
+                float *AccumulatedImpulse = Side == 0 ? &Constraint->LowerImpulse : &Constraint->UpperImpulse;
+                float Bias = Side == 0 ? Constraint->LowerBias : Constraint->UpperBias;
+                bool Soft = UseBias && Bias < 0.f;
+                if (!UseBias)
+                {
+                    Bias = Max(Bias, 0.f);
+                }
+
+                float Cdot = Sign * Dot(RelativeAngularVelocity(A, B), Axis);
+                float Impulse0 = *AccumulatedImpulse;
+                float Impulse = Soft ?
+                    -MassScale * Constraint->AxialMass * (Cdot + Bias) - ImpulseScale * Impulse0 :
+                    -Constraint->AxialMass * (Cdot + Bias);
+                *AccumulatedImpulse = Max(Impulse0 + Impulse, 0.f);
+                Impulse = *AccumulatedImpulse - Impulse0;
+                ApplyTwistImpulse(A, B, (Sign * Impulse) * Axis);
+                Residual = Max(Residual, fabsf(Impulse) * (Constraint->AxialMass > 0.f ? 1.f / Constraint->AxialMass : 0.f));
+            }
+        }
+
+        v3 *P = Constraint->Perpendicular;
+        v3 W = RelativeAngularVelocity(A, B);
+        float Cdot0 = Dot(P[0], W) + BiasScale * Constraint->AngularBias.x;
+        float Cdot1 = Dot(P[1], W) + BiasScale * Constraint->AngularBias.y;
+        float Impulse0 = -MassScale * (Constraint->AngularMass[0][0] * Cdot0 + Constraint->AngularMass[0][1] * Cdot1) -
+            ImpulseScale * Constraint->AngularImpulse.x;
+        float Impulse1 = -MassScale * (Constraint->AngularMass[1][0] * Cdot0 + Constraint->AngularMass[1][1] * Cdot1) -
+            ImpulseScale * Constraint->AngularImpulse.y;
+        Constraint->AngularImpulse.x += Impulse0;
+        Constraint->AngularImpulse.y += Impulse1;
+        ApplyTwistImpulse(A, B, Impulse0 * P[0] + Impulse1 * P[1]);
+        Residual = Max(Residual, Max(fabsf(Cdot0), fabsf(Cdot1)));
+    }
+    else if (Constraint->Type == JointType_Fixed)
+    {
+        v3 Cdot = RelativeAngularVelocity(A, B) + BiasScale * Constraint->AngularBias;
+        v3 Impulse = -MassScale * (Constraint->AngularMass * Cdot) - ImpulseScale * Constraint->AngularImpulse;
+        Constraint->AngularImpulse += Impulse;
+        ApplyTwistImpulse(A, B, Impulse);
+        Residual = Max(Residual, Length(Cdot));
+    }
+
+    v3 RelativeVelocity =
+        B->LinearVelocity + Cross(B->AngularVelocity, RB) -
+        A->LinearVelocity - Cross(A->AngularVelocity, RA);
+    v3 Cdot = RelativeVelocity + BiasScale * Constraint->LinearBias;
+    v3 Impulse = -MassScale * (Constraint->LinearMass * Cdot) - ImpulseScale * Constraint->LinearImpulse;
+    Constraint->LinearImpulse += Impulse;
+    ApplyContactImpulse(A, B, RA, RB, Impulse);
+    Residual = Max(Residual, Length(Cdot));
+
+    return Residual;
+}
+
+void StoreJointImpulses(world *World)
+{
+    for (i32 i = 0; i < World->JointConstraintCount; ++i)
+    {
+        joint_constraint *Constraint = World->JointConstraints + i;
+        joint *Joint = Constraint->Joint;
+        Joint->LinearImpulse = Constraint->LinearImpulse;
+        Joint->AngularImpulse = Constraint->AngularImpulse;
+        Joint->AxialImpulse = Constraint->AxialImpulse;
+        Joint->MotorImpulse = Constraint->MotorImpulse;
+        Joint->LowerImpulse = Constraint->LowerImpulse;
+        Joint->UpperImpulse = Constraint->UpperImpulse;
+    }
+}
+
+// Only the constraints of the large islands, see SolveContactIslands for the rest.
+float SolveContactConstraints(world *World)
+{
+    float Residual = 0.f;
+    for (i32 i = 0; i < World->LargeIslandJointCount; ++i)
+    {
+        Residual = Max(Residual, SolveJointConstraint(World->JointConstraints + i));
+    }
+    for (i32 i = 0; i < World->LargeIslandConstraintCount; ++i)
+    {
+        Residual = Max(Residual, SolveContactConstraint(World->ContactConstraints + i));
+    }
+    return Residual;
+}
+
+inline void ApplyBiasImpulse(body_motion *A, body_motion *B, v3 RA, v3 RB, v3 P)
+{
+    if (A->InverseMass > 0.f)
+    {
+        A->BiasLinearVelocity -= A->InverseMass * P;
+        A->BiasAngularVelocity -= A->WorldInverseInertia * Cross(RA, P);
+    }
+
+    if (B->InverseMass > 0.f)
+    {
+        B->BiasLinearVelocity += B->InverseMass * P;
+        B->BiasAngularVelocity += B->WorldInverseInertia * Cross(RB, P);
+    }
+}
+
+// Split impulses, penetration is solved on the bias velocities only. They move the bodies
+// apart in this step but are dropped afterwards, so pushing out never adds energy.
+void SolveContactPositions(world *World)
+{
+    for (i32 Iteration = 0; Iteration < World->PositionIterations; ++Iteration)
+    {
+        for (i32 ConstraintIndex = 0; ConstraintIndex < World->ContactConstraintCount; ++ConstraintIndex)
+        {
+            contact_constraint *Constraint = World->ContactConstraints + ConstraintIndex;
+            body_motion *A = GetBodyMotion(Constraint->EntityA);
+            body_motion *B = GetBodyMotion(Constraint->EntityB);
+            for (i32 i = 0; i < Constraint->PointCount; ++i)
+            {
+                contact_constraint_point *Point = Constraint->Points + i;
+                v3 RelativeVelocity =
+                    B->BiasLinearVelocity + Cross(B->BiasAngularVelocity, Point->RB) -
+                    A->BiasLinearVelocity - Cross(A->BiasAngularVelocity, Point->RA);
+
+                float Vn = Dot(RelativeVelocity, Constraint->Normal);
+                float BiasImpulse = Point->NormalMass * (Point->PositionBias - Vn);
+                float BiasImpulse0 = Point->BiasImpulse;
+                Point->BiasImpulse = Max(BiasImpulse0 + BiasImpulse, 0.0f);
+                BiasImpulse = Point->BiasImpulse - BiasImpulse0;
+                ApplyBiasImpulse(A, B, Point->RA, Point->RB, BiasImpulse * Constraint->Normal);
+            }
+        }
+    }
+}
+
+void WarmStartSoftContacts(world *World)
+{
+    for (i32 ConstraintIndex = 0; ConstraintIndex < World->ContactConstraintCount; ++ConstraintIndex)
+    {
+        contact_constraint *Constraint = World->ContactConstraints + ConstraintIndex;
+        body_motion *A = GetBodyMotion(Constraint->EntityA);
+        body_motion *B = GetBodyMotion(Constraint->EntityB);
+        for (i32 i = 0; i < Constraint->PointCount; ++i)
+        {
+            contact_constraint_point *Point = Constraint->Points + i;
+            v3 P =
+                Point->NormalImpulse * Constraint->Normal +
+                Point->TangentImpulse[0] * Constraint->Tangent[0] +
+                Point->TangentImpulse[1] * Constraint->Tangent[1];
+            ApplyContactImpulse(A, B, Point->RA, Point->RB, P);
+        }
+
+        if (Constraint->UsePatchFriction)
+        {
+            WarmStartPatchFriction(A, B, Constraint);
+        }
+    }
+}
+
+// Without UseBias this is the relax pass, which takes out the velocity the soft
+// constraints added to push the bodies apart.
+void SolveSoftContacts(world *World, contact_softness Softness, float h, bool UseBias)
+{
+    float MaxPushVelocity = 300.f;
+    float inv_h = 1.f / h;
+
+    for (i32 ConstraintIndex = 0; ConstraintIndex < World->ContactConstraintCount; ++ConstraintIndex)
+    {
+        contact_constraint *Constraint = World->ContactConstraints + ConstraintIndex;
+        body_motion *A = GetBodyMotion(Constraint->EntityA);
+        body_motion *B = GetBodyMotion(Constraint->EntityB);
+        v3 DeltaPosition = B->DeltaPosition - A->DeltaPosition;
+
+        for (i32 i = 0; i < Constraint->PointCount; ++i)
+        {
+            contact_constraint_point *Point = Constraint->Points + i;
+            v3 RA = Point->RA;
+            v3 RB = Point->RB;
 
-    // @TODO: Temporary basic hash function
-    i32 HashIndex = (53 * EntityA + 97 * EntityB) & (World->MaxArbiters - 1);
-    arbiter *Arbiter = World->Arbiters + HashIndex;
-    while (Arbiter)
-    {
-        if ((Arbiter->EntityA == EntityA) &&
-            (Arbiter->EntityB == EntityB))
+            // The anchors moved with the bodies since the contact was found.
+            v3 Delta = DeltaPosition +
+                (RotateVector(RB, B->DeltaRotation) - RB) -
+                (RotateVector(RA, A->DeltaRotation) - RA);
+            float Separation = Point->Penetration + Dot(Delta, Constraint->Normal);
+
+            float Bias = 0.f;
+            float MassScale = 1.f;
+            float ImpulseScale = 0.f;
+            if (Separation > 0.f)
+            {
+                // Not touching yet, only keep the bodies from closing the gap in this sub-step.
+                Bias = Separation * inv_h;
+            }
+            else if (UseBias)
+            {
+                Bias = Max(Softness.BiasRate * Separation, -MaxPushVelocity);
+                MassScale = Softness.MassScale;
+                ImpulseScale = Softness.ImpulseScale;
+            }
+
+            {
+                v3 RelativeVelocity =
+                    B->LinearVelocity + Cross(B->AngularVelocity, RB) -
+                    A->LinearVelocity - Cross(A->AngularVelocity, RA);
+
+                float Vn = Dot(RelativeVelocity, Constraint->Normal);
+                float NormalImpulse = -Point->NormalMass * MassScale * (Vn + Bias) - ImpulseScale * Point->NormalImpulse;
+                float NormalImpulse0 = Point->NormalImpulse;
+                Point->NormalImpulse = Max(NormalImpulse0 + NormalImpulse, 0.0f);
+                NormalImpulse = Point->NormalImpulse - NormalImpulse0;
+                ApplyContactImpulse(A, B, RA, RB, NormalImpulse * Constraint->Normal);
+            }
+
+            if (Constraint->UsePatchFriction)
+            {
+                continue;
+            }
+
+            float ImpulseClamp = Constraint->Friction * Point->NormalImpulse;
+            for (i32 k = 0; k < 2; ++k)
+            {
+                v3 RelativeVelocity =
+                    B->LinearVelocity + Cross(B->AngularVelocity, RB) -
+                    A->LinearVelocity - Cross(A->AngularVelocity, RA);
+
+                float Vt = Dot(RelativeVelocity, Constraint->Tangent[k]);
+                float TangentImpulse = Point->TangentMass[k] * (-Vt);
+                float TangentImpulse0 = Point->TangentImpulse[k];
+                Point->TangentImpulse[k] = Clamp(TangentImpulse0 + TangentImpulse, -ImpulseClamp, ImpulseClamp);
+                TangentImpulse = Point->TangentImpulse[k] - TangentImpulse0;
+                ApplyContactImpulse(A, B, RA, RB, TangentImpulse * Constraint->Tangent[k]);
+            }
+        }
+
+        if (Constraint->UsePatchFriction)
         {
-            break;
+            SolvePatchFriction(A, B, Constraint);
         }
+    }
+}
+
+// Soft step: every sub-step integrates the velocities, warm starts, solves the soft
+// contacts, integrates the positions and relaxes. Smaller steps with one iteration each
+// converge much better than more iterations on the full step. Gravity is applied here
+// instead of at the start of the step, the bodies are integrated when it returns.
+// The joints were prepared with the sub-step and are softened and relaxed like the
+// contacts, their bias follows the poses after every sub-step.
+void SolveSoftStep(world *World, v3 Gravity, float dt)
+{
+    // Stiffness scales with the mass of the bodies and not with the load, so the bottom of
+    // a tall stack sinks in the most. Anything much softer lets 10 box towers tip over.
+    float ContactHertz = 60.f;
+    float ContactDampingRatio = 10.f;
 
-        if (Arena)
+    i32 SubstepCount = Max(World->SubstepCount, 1);
+    float h = dt / SubstepCount;
+    float inv_h = 1.f / h;
+    // The contacts can't be stiffer than the sub-steps can resolve.
+    contact_softness Softness = ContactSoftness(Min(ContactHertz, 0.25f / h), ContactDampingRatio, h);
+
+    for (i32 i = 1; i < World->EntityCount; ++i)
+    {
+        body_motion *Motion = GetBodyMotion(i);
+        Motion->DeltaPosition = V3(0,0,0);
+        Motion->DeltaRotation = Rotation(V3(1,0,0), 0);
+    }
+
+    quaternion AngularVelocity;
+    AngularVelocity.w = 0;
+    for (i32 Substep = 0; Substep < SubstepCount; ++Substep)
+    {
+        for (i32 i = 1; i < World->EntityCount; ++i)
         {
-            // @TODO: Potentially very bad!!
-            // In the chain of arbiters we might have alive -> dead -> alive
-            // By mistake we will use the dead one in the chain even if the last alive one is the correct one!!
-            
-            // NOTE: An arbiter is invalid if EntityA is 0 (pointing to the null entity)
-            if (Arbiter->EntityA == 0)
+            rigid_body *Entity = GetEntityByHandle(i);
+            if (Entity->Type == RigidBodyType_Dynamic && !Entity->IsSleeping)
             {
-                arbiter *Temp = Arbiter->NextArbiter;
-                memset(Arbiter, 0, sizeof(*Arbiter));
-                Arbiter->EntityA = EntityA;
-                Arbiter->EntityB = EntityB;
-                Arbiter->NextArbiter = Temp;
-                break;
+                GetBodyMotion(i)->LinearVelocity += Gravity * h;
             }
-            else if (!Arbiter->NextArbiter)
+        }
+
+        WarmStartJointConstraints(World);
+        WarmStartSoftContacts(World);
+        for (i32 i = 0; i < World->JointConstraintCount; ++i)
+        {
+            SolveJointConstraint(World->JointConstraints + i);
+        }
+        SolveSoftContacts(World, Softness, h, true);
+
+        for (i32 i = 1; i < World->EntityCount; ++i)
+        {
+            rigid_body *Entity = GetEntityByHandle(i);
+            if (Entity->Type == RigidBodyType_Dynamic && !Entity->IsSleeping)
             {
-                Arbiter->NextArbiter = ArenaPushType(Arena, arbiter);
-                Arbiter->NextArbiter->EntityA = 0;
+                // The velocities are those of the center of mass, the body rotates about
+                // it and the origin follows.
+                body_motion *Motion = GetBodyMotion(i);
+                quaternion Orientation = GetBodyPose(i).Rotation;
+                v3 Center = CenterOfMass(i) + Motion->LinearVelocity * h;
+                Motion->DeltaPosition += Motion->LinearVelocity * h;
+                AngularVelocity.v = Motion->AngularVelocity;
+                Orientation += 0.5f * AngularVelocity * Orientation * h;
+                Orientation = Normalized(Orientation);
+                SetBodyPose(i, Center - RotateVector(Entity->LocalCenterOfMass, Orientation), Orientation);
+                Motion->DeltaRotation += 0.5f * AngularVelocity * Motion->DeltaRotation * h;
+                Motion->DeltaRotation = Normalized(Motion->DeltaRotation);
             }
         }
 
-        Arbiter = Arbiter->NextArbiter;
+        for (i32 i = 0; i < World->JointConstraintCount; ++i)
+        {
+            UpdateJointBias(World->JointConstraints + i, inv_h);
+            SolveJointConstraint(World->JointConstraints + i, false);
+        }
+        SolveSoftContacts(World, Softness, h, false);
     }
-    return Arbiter;
 }
 
-void MergeContacts(arbiter *Arbiter, contact_manifold *NewManifold)
+#define LARGE_ISLAND_CONSTRAINTS 128
+#define CONSTRAINTS_PER_ISLAND_TASK 64
+
+// Sorts the constraints by island. Islands with many constraints are moved to the front
+// and solved by the regular solver, which can spread a single island over the workers.
+// The small ones are packed into tasks that each run all the iterations on their own.
+void PartitionContactIslands(world *World)
 {
-    float WarmStartingFactor = 1.f;
-    world *World = GetWorld();
+    i32 ConstraintCount = World->ContactConstraintCount;
+    i32 JointCount = World->JointConstraintCount;
+    i32 *ConstraintIslands = ArenaPushArray(TemporaryArena(), ConstraintCount, i32);
+    i32 *JointIslands = ArenaPushArray(TemporaryArena(), JointCount, i32);
+    i32 *IslandOffsets = ArenaPushArray(TemporaryArena(), World->EntityCount, i32);
+    i32 *JointOffsets = ArenaPushArray(TemporaryArena(), World->EntityCount, i32);
+    for (i32 i = 0; i < ConstraintCount; ++i)
+    {
+        contact_constraint *Constraint = World->ContactConstraints + i;
+        bool DynamicA = GetEntityByHandle(Constraint->EntityA)->Type == RigidBodyType_Dynamic;
+        i32 Island = World->BodyIslands[DynamicA ? Constraint->EntityA : Constraint->EntityB];
+        ConstraintIslands[i] = Island;
+        IslandOffsets[Island]++;
+    }
+    for (i32 i = 0; i < JointCount; ++i)
+    {
+        joint_constraint *Constraint = World->JointConstraints + i;
+        bool DynamicA = GetEntityByHandle(Constraint->EntityA)->Type == RigidBodyType_Dynamic;
+        i32 Island = World->BodyIslands[DynamicA ? Constraint->EntityA : Constraint->EntityB];
+        JointIslands[i] = Island;
+        JointOffsets[Island]++;
+    }
+
+    // Counts become offsets, large islands first. Joints count towards the size of the
+    // island like contacts.
+    i32 LargeCount = 0;
+    i32 LargeJointCount = 0;
+    i32 LargeIslandCount = 0;
+    for (i32 Island = 0; Island < World->EntityCount; ++Island)
+    {
+        if (IslandOffsets[Island] + JointOffsets[Island] > LARGE_ISLAND_CONSTRAINTS)
+        {
+            LargeCount += IslandOffsets[Island];
+            LargeJointCount += JointOffsets[Island];
+            LargeIslandCount++;
+        }
+    }
+
+    i32 LargeOffset = 0;
+    i32 LargeJointOffset = 0;
+    i32 SmallOffset = LargeCount;
+    i32 SmallJointOffset = LargeJointCount;
+    // Every small island starts at most one task.
+    contact_island_task *Tasks = ArenaPushArray(TemporaryArena(), World->EntityCount, contact_island_task);
+    contact_island *Islands = ArenaPushArray(TemporaryArena(), World->EntityCount, contact_island);
+    i32 TaskCount = 0;
+    i32 SmallIslandCount = 0;
+    i32 TaskConstraintCount = 0;
+    for (i32 Island = 0; Island < World->EntityCount; ++Island)
+    {
+        i32 Count = IslandOffsets[Island];
+        i32 IslandJointCount = JointOffsets[Island];
+        if (Count + IslandJointCount == 0)
+        {
+            continue;
+        }
+
+        if (Count + IslandJointCount > LARGE_ISLAND_CONSTRAINTS)
+        {
+            IslandOffsets[Island] = LargeOffset;
+            LargeOffset += Count;
+            JointOffsets[Island] = LargeJointOffset;
+            LargeJointOffset += IslandJointCount;
+            continue;
+        }
+
+        contact_island_task *Task = TaskCount ? Tasks + TaskCount - 1 : 0;
+        if (!Task || TaskConstraintCount + Count + IslandJointCount > CONSTRAINTS_PER_ISLAND_TASK)
+        {
+            Task = Tasks + TaskCount++;
+            *Task = {};
+            Task->FirstIsland = SmallIslandCount;
+            TaskConstraintCount = 0;
+        }
+        TaskConstraintCount += Count + IslandJointCount;
+        Task->IslandCount++;
+        contact_island *SmallIsland = Islands + SmallIslandCount++;
+        SmallIsland->FirstConstraint = SmallOffset;
+        SmallIsland->ConstraintCount = Count;
+        SmallIsland->FirstJoint = SmallJointOffset;
+        SmallIsland->JointCount = IslandJointCount;
+        IslandOffsets[Island] = SmallOffset;
+        SmallOffset += Count;
+        JointOffsets[Island] = SmallJointOffset;
+        SmallJointOffset += IslandJointCount;
+    }
+
+    contact_constraint *Sorted = ArenaPushArrayAligned(TemporaryArena(), ConstraintCount, contact_constraint);
+    for (i32 i = 0; i < ConstraintCount; ++i)
+    {
+        Sorted[IslandOffsets[ConstraintIslands[i]]++] = World->ContactConstraints[i];
+    }
+
+    joint_constraint *SortedJoints = ArenaPushArrayAligned(TemporaryArena(), JointCount, joint_constraint);
+    for (i32 i = 0; i < JointCount; ++i)
+    {
+        SortedJoints[JointOffsets[JointIslands[i]]++] = World->JointConstraints[i];
+    }
+
+    World->ContactConstraints = Sorted;
+    World->JointConstraints = SortedJoints;
+    World->LargeIslandConstraintCount = LargeCount;
+    World->LargeIslandJointCount = LargeJointCount;
+    World->LargeIslandCount = LargeIslandCount;
+    World->IslandTasks = Tasks;
+    World->IslandTaskCount = TaskCount;
+    World->ContactIslands = Islands;
+}
+
+inline i32 GetSolverIterationCap(world *World)
+{
+    i32 Result = World->SolverIterations < MAX_SOLVER_ITERATIONS ? World->SolverIterations : MAX_SOLVER_ITERATIONS;
+    return Result > 1 ? Result : 1;
+}
 
-    contact_manifold MergedManifold = *NewManifold;
-    contact_point *MergedContacts = MergedManifold.Points;
+// A warm started iteration changes little even when the solution is still far off, so
+// a few iterations always run before the residual is trusted.
+inline bool IsSolverConverged(world *World, i32 Iteration, float Residual)
+{
+    return Iteration >= MIN_SOLVER_ITERATIONS && Residual < World->SolverTolerance;
+}
 
-    for (int i = 0; i < NewManifold->PointCount; ++i)
+static void SolveContactIslandWork(void *Data)
+{
+    contact_island_task *Task = (contact_island_task *)Data;
+    world *World = GetWorld();
+    i32 MaxIterations = GetSolverIterationCap(World);
+    for (i32 IslandIndex = 0; IslandIndex < Task->IslandCount; ++IslandIndex)
     {
-        contact_point *NewContact = NewManifold->Points + i;
-        int k = -1;
-        for (int j = 0; j < Arbiter->Manifold.PointCount; ++j)
+        contact_island *Island = World->ContactIslands + Task->FirstIsland + IslandIndex;
+        contact_constraint *Constraints = World->ContactConstraints + Island->FirstConstraint;
+        joint_constraint *Joints = World->JointConstraints + Island->FirstJoint;
+        i32 Iteration = 0;
+        while (Iteration < MaxIterations)
         {
-            contact_point *OldContact = Arbiter->Manifold.Points + j;
-            if (NewContact->ID.Type == OldContact->ID.Type &&
-                NewContact->ID.Value == OldContact->ID.Value)
+            float Residual = 0.f;
+            for (i32 i = 0; i < Island->JointCount; ++i)
+            {
+                Residual = Max(Residual, SolveJointConstraint(Joints + i));
+            }
+            for (i32 i = 0; i < Island->ConstraintCount; ++i)
+            {
+                Residual = Max(Residual, SolveContactConstraint(Constraints + i));
+            }
+            Task->Residuals[Iteration] = Max(Task->Residuals[Iteration], Residual);
+            ++Iteration;
+
+            if (IsSolverConverged(World, Iteration, Residual))
             {
-                k = j;
                 break;
             }
         }
+        Task->MaxIterations = Task->MaxIterations > Iteration ? Task->MaxIterations : Iteration;
+        Task->IterationSum += Iteration;
+    }
+}
 
-        if (k > -1)
-        {
-            contact_point *Contact = MergedContacts + i;
-            contact_point *OldContact = Arbiter->Manifold.Points + k;
-            World->DEBUG_ReusedContacts++;
+// Called before the contacts are solved.
+void ResetSolverStats(world *World)
+{
+    for (i32 i = 0; i < MAX_SOLVER_ITERATIONS; ++i)
+    {
+        World->DEBUG_SolverResiduals[i] = 0.f;
+    }
+    World->DEBUG_MaxSolverIterations = 0;
+    World->DEBUG_SolverIterationSum = 0;
+    World->DEBUG_SolvedIslandCount = 0;
+}
+
+void AddSolverStats(world *World, float *Residuals, i32 MaxIterations, i32 IterationSum, i32 IslandCount)
+{
+    for (i32 i = 0; i < MaxIterations; ++i)
+    {
+        World->DEBUG_SolverResiduals[i] = Max(World->DEBUG_SolverResiduals[i], Residuals[i]);
+    }
+    if (MaxIterations > World->DEBUG_MaxSolverIterations)
+    {
+        World->DEBUG_MaxSolverIterations = MaxIterations;
+    }
+    World->DEBUG_SolverIterationSum += IterationSum;
+    World->DEBUG_SolvedIslandCount += IslandCount;
+}
 
-            Contact->NormalImpulse = OldContact->NormalImpulse * WarmStartingFactor;
-            Contact->FrictionImpulse = OldContact->FrictionImpulse * WarmStartingFactor;
-            Contact->TangentImpulse = OldContact->TangentImpulse * WarmStartingFactor;
-            Contact->BiasImpulse = OldContact->BiasImpulse * WarmStartingFactor;
+// Islands share no dynamic body, so the tasks never touch the same body and can run in
+// any order.
+void SolveContactIslands(world *World)
+{
+    for (i32 i = 0; i < World->IslandTaskCount; ++i)
+    {
+        if (World->UseSolverThreads)
+        {
+            PlatformAddWork(SolveContactIslandWork, World->IslandTasks + i);
         }
         else
         {
-            World->DEBUG_NewContacts++;
-            MergedContacts[i] = *NewContact;
+            SolveContactIslandWork(World->IslandTasks + i);
         }
     }
+    PlatformCompleteAllWork();
+
+    for (i32 i = 0; i < World->IslandTaskCount; ++i)
+    {
+        contact_island_task *Task = World->IslandTasks + i;
+        AddSolverStats(World, Task->Residuals, Task->MaxIterations, Task->IterationSum, Task->IslandCount);
+    }
+}
 
-    Arbiter->Manifold = MergedManifold;
+void StoreContactImpulses(world *World)
+{
+    for (i32 ConstraintIndex = 0; ConstraintIndex < World->ContactConstraintCount; ++ConstraintIndex)
+    {
+        contact_constraint *Constraint = World->ContactConstraints + ConstraintIndex;
+        contact_manifold *Manifold = Constraint->Manifold;
+        for (i32 i = 0; i < Constraint->PointCount; ++i)
+        {
+            contact_point *Contact = Manifold->Points + i;
+            contact_constraint_point *Point = Constraint->Points + i;
+            Contact->NormalImpulse = Point->NormalImpulse;
+            Contact->FrictionImpulse = Point->TangentImpulse[0];
+            Contact->TangentImpulse = Point->TangentImpulse[1];
+            Contact->BiasImpulse = Point->BiasImpulse;
+        }
+        Manifold->PatchImpulse[0] = Constraint->PatchImpulse[0];
+        Manifold->PatchImpulse[1] = Constraint->PatchImpulse[1];
+        Manifold->TwistImpulse = Constraint->TwistImpulse;
+    }
 }
 
-void Broadphase(world *World, arena *Arena)
+// Greedy graph coloring of the large islands, every constraint gets the lowest color that
+// none of its dynamic bodies has yet. Static bodies are never written to, so they can be
+// shared between the constraints of a color. Each color is then cut into batches of 4 for
+// the SIMD solver.
+void BuildContactBatches(world *World)
 {
-    i32 MaxPairs = 512;
-    i32 PairCount = 0;
-    collision_pair *Pairs = ArenaPushArray(TemporaryArena(), MaxPairs, collision_pair);
+    i32 ConstraintCount = World->LargeIslandConstraintCount;
+    u32 *BodyColors = ArenaPushArray(TemporaryArena(), World->EntityCount, u32);
+    i32 *ConstraintColors = ArenaPushArray(TemporaryArena(), ConstraintCount, i32);
+    i32 ColorCounts[MAX_CONTACT_COLORS] = {};
 
-    // O(n^2) broadphase, @TODO: Replace with dynamic "fat" AABB tree
-    for (i32 i = 1; i < World->EntityCount; ++i)
+    World->OverflowConstraintCount = 0;
+    World->OverflowConstraints = ArenaPushArray(TemporaryArena(), ConstraintCount, i32);
+    for (i32 i = 0; i < ConstraintCount; ++i)
     {
-        for (i32 j = i+1; j < World->EntityCount; ++j)
+        contact_constraint *Constraint = World->ContactConstraints + i;
+        bool DynamicA = GetEntityByHandle(Constraint->EntityA)->Type == RigidBodyType_Dynamic;
+        bool DynamicB = GetEntityByHandle(Constraint->EntityB)->Type == RigidBodyType_Dynamic;
+        u32 UsedColors = 0;
+        if (DynamicA) UsedColors |= BodyColors[Constraint->EntityA];
+        if (DynamicB) UsedColors |= BodyColors[Constraint->EntityB];
+
+        i32 Color = 0;
+        while (Color < MAX_CONTACT_COLORS && (UsedColors & (1u << Color)))
         {
-            rigid_body *A = GetEntityByHandle(i);
-            rigid_body *B = GetEntityByHandle(j);
+            Color++;
+        }
 
-            contact_manifold Manifold;
-            bool Collision = CollideHulls(A->Hull, A->Transform, B->Hull, B->Transform, &Manifold);
-            World->DEBUG_SATCalls++;
+        if (Color == MAX_CONTACT_COLORS)
+        {
+            ConstraintColors[i] = -1;
+            World->OverflowConstraints[World->OverflowConstraintCount++] = i;
+            continue;
+        }
+
+        if (DynamicA) BodyColors[Constraint->EntityA] |= 1u << Color;
+        if (DynamicB) BodyColors[Constraint->EntityB] |= 1u << Color;
+        ConstraintColors[i] = Color;
+        ColorCounts[Color]++;
+    }
+
+    i32 *ColorBatches = World->ContactColorBatches;
+    i32 BatchCount = 0;
+    for (i32 Color = 0; Color < MAX_CONTACT_COLORS; ++Color)
+    {
+        ColorBatches[Color] = BatchCount;
+        BatchCount += (ColorCounts[Color] + 3) / 4;
+    }
+    ColorBatches[MAX_CONTACT_COLORS] = BatchCount;
+
+    contact_constraint_4x *Batches = ArenaPushArrayAligned(TemporaryArena(), BatchCount, contact_constraint_4x);
+    i32 ColorFill[MAX_CONTACT_COLORS] = {};
+    for (i32 i = 0; i < ConstraintCount; ++i)
+    {
+        i32 Color = ConstraintColors[i];
+        if (Color == -1)
+        {
+            continue;
+        }
+
+        i32 Fill = ColorFill[Color]++;
+        contact_constraint_4x *Batch = Batches + ColorBatches[Color] + Fill / 4;
+        i32 Lane = Fill % 4;
+        contact_constraint *Constraint = World->ContactConstraints + i;
+        Batch->EntityA[Lane] = Constraint->EntityA;
+        Batch->EntityB[Lane] = Constraint->EntityB;
+        Batch->Constraints[Lane] = Constraint;
+        if (Constraint->PointCount > Batch->PointCount)
+        {
+            Batch->PointCount = Constraint->PointCount;
+        }
+    }
+
+    // Transpose the lanes into SoA, anything not written stays zero.
+    for (i32 BatchIndex = 0; BatchIndex < BatchCount; ++BatchIndex)
+    {
+        contact_constraint_4x *Batch = Batches + BatchIndex;
+        alignas(16) float Lanes[4];
+#define TRANSPOSE_LANES(_wide, _scalar) \
+        for (i32 Lane = 0; Lane < 4; ++Lane) \
+        { \
+            contact_constraint *Constraint = Batch->Constraints[Lane]; \
+            Lanes[Lane] = Constraint ? (_scalar) : 0.f; \
+        } \
+        _wide = LoadF32_4x(Lanes);
 
-            if (Collision)
+        for (i32 Axis = 0; Axis < 3; ++Axis)
+        {
+            f32_4x *Normal = &Batch->Normal.x + Axis;
+            TRANSPOSE_LANES(*Normal, Constraint->Normal[Axis]);
+            for (i32 k = 0; k < 2; ++k)
             {
-                World->DEBUG_DetectedCollisions++;
-                arbiter *Arbiter = GetArbiter(World, i, j, Arena);
-                MergeContacts(Arbiter, &Manifold);
-                Arbiter->WasUpdated = true;
-                Pairs[PairCount++] = {i,j};
+                f32_4x *Tangent = &Batch->Tangent[k].x + Axis;
+                TRANSPOSE_LANES(*Tangent, Constraint->Tangent[k][Axis]);
+            }
+        }
+        TRANSPOSE_LANES(Batch->Friction, Constraint->Friction);
+        TRANSPOSE_LANES(Batch->InverseMassA, GetBodyMotion(Constraint->EntityA)->InverseMass);
+        TRANSPOSE_LANES(Batch->InverseMassB, GetBodyMotion(Constraint->EntityB)->InverseMass);
+        for (i32 Row = 0; Row < 3; ++Row)
+        {
+            for (i32 Column = 0; Column < 3; ++Column)
+            {
+                TRANSPOSE_LANES(Batch->InverseInertiaA.e[Row][Column],
+                                GetBodyMotion(Constraint->EntityA)->WorldInverseInertia[Row][Column]);
+                TRANSPOSE_LANES(Batch->InverseInertiaB.e[Row][Column],
+                                GetBodyMotion(Constraint->EntityB)->WorldInverseInertia[Row][Column]);
+            }
+        }
+
+        Batch->UsePatchFriction = World->UsePatchFriction;
+        if (Batch->UsePatchFriction)
+        {
+            for (i32 Axis = 0; Axis < 3; ++Axis)
+            {
+                TRANSPOSE_LANES((&Batch->PatchRA.x)[Axis], Constraint->PatchRA[Axis]);
+                TRANSPOSE_LANES((&Batch->PatchRB.x)[Axis], Constraint->PatchRB[Axis]);
             }
+            TRANSPOSE_LANES(Batch->PatchTangentMass[0], Constraint->PatchTangentMass[0]);
+            TRANSPOSE_LANES(Batch->PatchTangentMass[1], Constraint->PatchTangentMass[1]);
+            TRANSPOSE_LANES(Batch->TwistMass, Constraint->TwistMass);
+            TRANSPOSE_LANES(Batch->FrictionRadius, Constraint->FrictionRadius);
+            TRANSPOSE_LANES(Batch->PatchImpulse[0], Constraint->PatchImpulse[0]);
+            TRANSPOSE_LANES(Batch->PatchImpulse[1], Constraint->PatchImpulse[1]);
+            TRANSPOSE_LANES(Batch->TwistImpulse, Constraint->TwistImpulse);
         }
+
+        for (i32 i = 0; i < Batch->PointCount; ++i)
+        {
+            contact_constraint_point_4x *Point = Batch->Points + i;
+#define POINT(_field) (i < Constraint->PointCount ? Constraint->Points[i]._field : 0.f)
+            for (i32 Axis = 0; Axis < 3; ++Axis)
+            {
+                TRANSPOSE_LANES((&Point->RA.x)[Axis], POINT(RA[Axis]));
+                TRANSPOSE_LANES((&Point->RB.x)[Axis], POINT(RB[Axis]));
+            }
+            TRANSPOSE_LANES(Point->NormalMass, POINT(NormalMass));
+            TRANSPOSE_LANES(Point->TangentMass[0], POINT(TangentMass[0]));
+            TRANSPOSE_LANES(Point->TangentMass[1], POINT(TangentMass[1]));
+            TRANSPOSE_LANES(Point->Bias, POINT(Bias));
+            TRANSPOSE_LANES(Point->NormalImpulse, POINT(NormalImpulse));
+            TRANSPOSE_LANES(Point->TangentImpulse[0], POINT(TangentImpulse[0]));
+            TRANSPOSE_LANES(Point->TangentImpulse[1], POINT(TangentImpulse[1]));
+#undef POINT
+        }
+#undef TRANSPOSE_LANES
     }
 
-    World->CollisionPairs = Pairs;
-    World->CollisionPairCount = PairCount;
+    World->ContactBatches = Batches;
+    World->ContactBatchCount = BatchCount;
+}
 
-    for (i32 i = 1; i < World->EntityCount; ++i)
+static void GatherVelocities(i32 *Entities, v3_4x *LinearVelocity, v3_4x *AngularVelocity)
+{
+    alignas(16) float Values[6][4] = {};
+    for (i32 Lane = 0; Lane < 4; ++Lane)
     {
-        // j = i+1 so we only loop over distinct pairs, otherwise we may eject an arbiter when we didnt mean to
-        for (i32 j = i+1; j < World->EntityCount; ++j)
+        if (Entities[Lane])
         {
-            arbiter *Arbiter = GetArbiter(World, i, j);
-            if (Arbiter)
+            body_motion *Motion = GetBodyMotion(Entities[Lane]);
+            for (i32 Axis = 0; Axis < 3; ++Axis)
             {
-                if (!Arbiter->WasUpdated)
-                {
-                    // This is an outdated arbiter, clear its contents so the memory can be reused in the future.
-                    *Arbiter = {};
-                }
-
-                Arbiter->WasUpdated = false;
+                Values[Axis][Lane] = Motion->LinearVelocity[Axis];
+                Values[3 + Axis][Lane] = Motion->AngularVelocity[Axis];
             }
         }
     }
+
+    LinearVelocity->x = LoadF32_4x(Values[0]);
+    LinearVelocity->y = LoadF32_4x(Values[1]);
+    LinearVelocity->z = LoadF32_4x(Values[2]);
+    AngularVelocity->x = LoadF32_4x(Values[3]);
+    AngularVelocity->y = LoadF32_4x(Values[4]);
+    AngularVelocity->z = LoadF32_4x(Values[5]);
 }
 
-void ApplyImpulses(arbiter *Arbiter, float dt)
+static void ScatterVelocities(i32 *Entities, v3_4x LinearVelocity, v3_4x AngularVelocity)
 {
-    rigid_body *A = GetEntityByHandle(Arbiter->EntityA);
-    rigid_body *B = GetEntityByHandle(Arbiter->EntityB);
+    alignas(16) float Values[6][4];
+    StoreF32_4x(Values[0], LinearVelocity.x);
+    StoreF32_4x(Values[1], LinearVelocity.y);
+    StoreF32_4x(Values[2], LinearVelocity.z);
+    StoreF32_4x(Values[3], AngularVelocity.x);
+    StoreF32_4x(Values[4], AngularVelocity.y);
+    StoreF32_4x(Values[5], AngularVelocity.z);
 
-    float Friction = 0.5f;
-    float Slop = 0.01f;
-    float BiasFactor = 0.2f;
-    float inv_dt = 1.f / dt;
-    v3 Normal = Normalized(Arbiter->Manifold.Normal);
+    for (i32 Lane = 0; Lane < 4; ++Lane)
+    {
+        if (!Entities[Lane])
+        {
+            continue;
+        }
+
+        body_motion *Motion = GetBodyMotion(Entities[Lane]);
+        if (Motion->InverseMass == 0.f)
+        {
+            continue;
+        }
+
+        for (i32 Axis = 0; Axis < 3; ++Axis)
+        {
+            Motion->LinearVelocity[Axis] = Values[Axis][Lane];
+            Motion->AngularVelocity[Axis] = Values[3 + Axis][Lane];
+        }
+    }
+}
+
+// Same as SolveContactConstraint for four constraints at once.
+float SolveContactBatch(contact_constraint_4x *Batch)
+{
+    v3_4x LinearVelocityA, AngularVelocityA;
+    v3_4x LinearVelocityB, AngularVelocityB;
+    GatherVelocities(Batch->EntityA, &LinearVelocityA, &AngularVelocityA);
+    GatherVelocities(Batch->EntityB, &LinearVelocityB, &AngularVelocityB);
 
-    for (i32 i = 0; i < Arbiter->Manifold.PointCount; ++i)
+    f32_4x Zero = F32_4x(0.f);
+    // Empty lanes have no mass and never get an impulse.
+    f32_4x MinMass = F32_4x(FLT_MIN);
+    f32_4x Residual = Zero;
+    for (i32 i = 0; i < Batch->PointCount; ++i)
     {
-        contact_point *Contact = Arbiter->Manifold.Points + i;
-        v3 CA = CenterOfMass(A);
-        v3 CB = CenterOfMass(B);
-        
-        v3 RA = Contact->Position - CA;
-        v3 RB = Contact->Position - CB;
+        contact_constraint_point_4x *Point = Batch->Points + i;
+        v3_4x RA = Point->RA;
+        v3_4x RB = Point->RB;
 
         {
-            v3 RelativeVelocity = 
-                B->LinearVelocity + Cross(B->AngularVelocity, RB) -
-                A->LinearVelocity - Cross(A->AngularVelocity, RA);
+            v3_4x RelativeVelocity =
+                LinearVelocityB + Cross(AngularVelocityB, RB) -
+                LinearVelocityA - Cross(AngularVelocityA, RA);
 
-            float MassNormal = A->InverseMass + B->InverseMass;
-            MassNormal += Dot(A->InverseInertia * Cross(Cross(RA, Normal), RA) +
-                              B->InverseInertia * Cross(Cross(RB, Normal), RB),
-                              Normal);
-            MassNormal = 1.f / MassNormal;
+            f32_4x Vn = Dot(RelativeVelocity, Batch->Normal);
+            f32_4x NormalImpulse = Point->NormalMass * (Point->Bias - Vn);
+            f32_4x NormalImpulse0 = Point->NormalImpulse;
+            Point->NormalImpulse = Max(NormalImpulse + NormalImpulse0, Zero);
+            NormalImpulse = Point->NormalImpulse - NormalImpulse0;
+            Residual = Max(Residual, Abs(NormalImpulse) / Max(Point->NormalMass, MinMass));
 
-            float Vn = Dot(RelativeVelocity, Normal);
-            float Bias = -BiasFactor * inv_dt * Min(0.0f, Contact->Penetration + Slop);
-            float NormalImpulse = MassNormal * (-Vn + Bias);
-            float NormalImpulse0 = Contact->NormalImpulse;
-            Contact->NormalImpulse = Max(NormalImpulse + NormalImpulse0, 0.0f);
-            NormalImpulse = Contact->NormalImpulse - NormalImpulse0;
-            v3 P = NormalImpulse * Normal;
+            v3_4x P = Batch->Normal * NormalImpulse;
+            LinearVelocityA = LinearVelocityA - P * Batch->InverseMassA;
+            AngularVelocityA = AngularVelocityA - Batch->InverseInertiaA * Cross(RA, P);
+            LinearVelocityB = LinearVelocityB + P * Batch->InverseMassB;
+            AngularVelocityB = AngularVelocityB + Batch->InverseInertiaB * Cross(RB, P);
+        }
 
-            if (A->Type == RigidBodyType_Dynamic)
-            {
-                A->LinearMomentum -= P;
-                A->AngularMomentum -= Cross(RA, P);
-                A->Recalculate();
-            }
+        if (Batch->UsePatchFriction)
+        {
+            continue;
+        }
 
-            if (B->Type == RigidBodyType_Dynamic)
-            {
-                B->LinearMomentum += P;
-                B->AngularMomentum += Cross(RB, P);
-                B->Recalculate();
-            }
+        f32_4x ImpulseClamp = Batch->Friction * Point->NormalImpulse;
+        for (i32 k = 0; k < 2; ++k)
+        {
+            v3_4x RelativeVelocity =
+                LinearVelocityB + Cross(AngularVelocityB, RB) -
+                LinearVelocityA - Cross(AngularVelocityA, RA);
+
+            f32_4x Vt = Dot(RelativeVelocity, Batch->Tangent[k]);
+            f32_4x TangentImpulse = -(Point->TangentMass[k] * Vt);
+            f32_4x TangentImpulse0 = Point->TangentImpulse[k];
+            Point->TangentImpulse[k] = Clamp(TangentImpulse0 + TangentImpulse, -ImpulseClamp, ImpulseClamp);
+            TangentImpulse = Point->TangentImpulse[k] - TangentImpulse0;
+            Residual = Max(Residual, Abs(TangentImpulse) / Max(Point->TangentMass[k], MinMass));
+
+            v3_4x P = Batch->Tangent[k] * TangentImpulse;
+            LinearVelocityA = LinearVelocityA - P * Batch->InverseMassA;
+            AngularVelocityA = AngularVelocityA - Batch->InverseInertiaA * Cross(RA, P);
+            LinearVelocityB = LinearVelocityB + P * Batch->InverseMassB;
+            AngularVelocityB = AngularVelocityB + Batch->InverseInertiaB * Cross(RB, P);
         }
+    }
 
+    // Same as SolvePatchFriction.
+    if (Batch->UsePatchFriction)
+    {
+        f32_4x NormalImpulse = Zero;
+        for (i32 i = 0; i < Batch->PointCount; ++i)
         {
-            v3 RelativeVelocity = 
-                B->LinearVelocity + Cross(B->AngularVelocity, RB) -
-                A->LinearVelocity - Cross(A->AngularVelocity, RA);
+            NormalImpulse = NormalImpulse + Batch->Points[i].NormalImpulse;
+        }
+        f32_4x MaxImpulse = Batch->Friction * NormalImpulse;
 
-            v3 Tangent = RelativeVelocity - Dot(RelativeVelocity, Normal) * Normal;
-            if (!IsZeroVector(Tangent))
-            {
-                Tangent = Normalized(Tangent);
-                float MassTangent = A->InverseMass + B->InverseMass;
-                MassTangent += Dot(A->InverseInertia * Cross(Cross(RA, Tangent), RA) +
-                                   B->InverseInertia * Cross(Cross(RB, Tangent), RB),
-                                   Tangent);
-                MassTangent = 1.f / MassTangent;
-                float Vt = Dot(RelativeVelocity, Tangent);
-                float TangentImpulse = MassTangent * (-Vt);
-                float ImpulseClamp = Friction * Contact->NormalImpulse;
-                float TangentImpulse0 = Contact->FrictionImpulse;
-                Contact->FrictionImpulse = Clamp(TangentImpulse0 + TangentImpulse, -ImpulseClamp, ImpulseClamp);
-                TangentImpulse = Contact->FrictionImpulse - TangentImpulse0;
-                v3 P = TangentImpulse * Tangent;
+        v3_4x RA = Batch->PatchRA;
+        v3_4x RB = Batch->PatchRB;
+        v3_4x RelativeVelocity =
+            LinearVelocityB + Cross(AngularVelocityB, RB) -
+            LinearVelocityA - Cross(AngularVelocityA, RA);
 
-                if (A->Type == RigidBodyType_Dynamic)
-                {
-                    A->LinearMomentum -= P;
-                    A->AngularMomentum -= Cross(RA, P);
-                    A->Recalculate();
-                }
+        f32_4x Impulse0[2] = {Batch->PatchImpulse[0], Batch->PatchImpulse[1]};
+        f32_4x Impulse[2];
+        for (i32 k = 0; k < 2; ++k)
+        {
+            f32_4x Vt = Dot(RelativeVelocity, Batch->Tangent[k]);
+            Impulse[k] = Impulse0[k] - Batch->PatchTangentMass[k] * Vt;
+        }
 
-                if (B->Type == RigidBodyType_Dynamic)
-                {
-                    B->LinearMomentum += P;
-                    B->AngularMomentum += Cross(RB, P);
-                    B->Recalculate();
-                }
+        f32_4x ImpulseLength = SquareRoot(Impulse[0] * Impulse[0] + Impulse[1] * Impulse[1]);
+        f32_4x Scale = Min(F32_4x(1.f), MaxImpulse / Max(ImpulseLength, MinMass));
+        v3_4x P = {Zero, Zero, Zero};
+        for (i32 k = 0; k < 2; ++k)
+        {
+            Batch->PatchImpulse[k] = Impulse[k] * Scale;
+            f32_4x Delta = Batch->PatchImpulse[k] - Impulse0[k];
+            Residual = Max(Residual, Abs(Delta) / Max(Batch->PatchTangentMass[k], MinMass));
+            P = P + Batch->Tangent[k] * Delta;
+        }
+        LinearVelocityA = LinearVelocityA - P * Batch->InverseMassA;
+        AngularVelocityA = AngularVelocityA - Batch->InverseInertiaA * Cross(RA, P);
+        LinearVelocityB = LinearVelocityB + P * Batch->InverseMassB;
+        AngularVelocityB = AngularVelocityB + Batch->InverseInertiaB * Cross(RB, P);
+
+        // Lanes without twist mass get no twist impulse.
+        f32_4x MaxTwist = Batch->FrictionRadius * MaxImpulse;
+        f32_4x Wn = Dot(AngularVelocityB - AngularVelocityA, Batch->Normal);
+        f32_4x TwistImpulse0 = Batch->TwistImpulse;
+        Batch->TwistImpulse = Clamp(TwistImpulse0 - Batch->TwistMass * Wn, -MaxTwist, MaxTwist);
+        f32_4x TwistImpulse = Batch->TwistImpulse - TwistImpulse0;
+        Residual = Max(Residual, Abs(TwistImpulse) / Max(Batch->TwistMass, MinMass) * Batch->FrictionRadius);
+
+        v3_4x L = Batch->Normal * TwistImpulse;
+        AngularVelocityA = AngularVelocityA - Batch->InverseInertiaA * L;
+        AngularVelocityB = AngularVelocityB + Batch->InverseInertiaB * L;
+    }
+
+    ScatterVelocities(Batch->EntityA, LinearVelocityA, AngularVelocityA);
+    ScatterVelocities(Batch->EntityB, LinearVelocityB, AngularVelocityB);
+    return HorizontalMax(Residual);
+}
+
+struct contact_batch_work
+{
+    contact_constraint_4x *Batches;
+    i32 BatchCount;
+    float Residual;
+};
+
+static void SolveContactBatchWork(void *Data)
+{
+    contact_batch_work *Work = (contact_batch_work *)Data;
+    Work->Residual = 0.f;
+    for (i32 i = 0; i < Work->BatchCount; ++i)
+    {
+        Work->Residual = Max(Work->Residual, SolveContactBatch(Work->Batches + i));
+    }
+}
+
+#define MIN_BATCHES_PER_TASK 8
+#define MAX_TASKS_PER_COLOR 64
+
+// The batches of one color share no dynamic body, so they are split between the workers
+// and the colors are separated by waiting for all the work to complete. Since no two
+// threads ever touch the same body, the result doesn't depend on the number of threads.
+float SolveContactBatches(world *World)
+{
+    // Joints are few, they are solved serially before the colors.
+    float Residual = 0.f;
+    for (i32 i = 0; i < World->LargeIslandJointCount; ++i)
+    {
+        Residual = Max(Residual, SolveJointConstraint(World->JointConstraints + i));
+    }
+
+    for (i32 Color = 0; Color < MAX_CONTACT_COLORS; ++Color)
+    {
+        i32 FirstBatch = World->ContactColorBatches[Color];
+        i32 BatchCount = World->ContactColorBatches[Color + 1] - FirstBatch;
+        if (!World->UseSolverThreads || BatchCount <= MIN_BATCHES_PER_TASK)
+        {
+            for (i32 i = 0; i < BatchCount; ++i)
+            {
+                Residual = Max(Residual, SolveContactBatch(World->ContactBatches + FirstBatch + i));
             }
+            continue;
         }
 
+        i32 BatchesPerTask = (BatchCount + MAX_TASKS_PER_COLOR - 1) / MAX_TASKS_PER_COLOR;
+        if (BatchesPerTask < MIN_BATCHES_PER_TASK)
+        {
+            BatchesPerTask = MIN_BATCHES_PER_TASK;
+        }
 
+        contact_batch_work Work[MAX_TASKS_PER_COLOR];
+        i32 WorkCount = 0;
+        for (i32 i = 0; i < BatchCount; i += BatchesPerTask)
         {
-            v3 RelativeVelocity = 
-                B->LinearVelocity + Cross(B->AngularVelocity, RB) -
-                A->LinearVelocity - Cross(A->AngularVelocity, RA);
+            contact_batch_work *Task = Work + WorkCount++;
+            Task->Batches = World->ContactBatches + FirstBatch + i;
+            Task->BatchCount = (BatchCount - i < BatchesPerTask) ? BatchCount - i : BatchesPerTask;
+            PlatformAddWork(SolveContactBatchWork, Task);
+        }
+        PlatformCompleteAllWork();
 
-            v3 Tangent = RelativeVelocity - Dot(RelativeVelocity, Normal) * Normal;
-            Tangent = Cross(Tangent, Normal);
-            if (!IsZeroVector(Tangent))
-            {
-                Tangent = Normalized(Tangent);
-                float MassTangent = A->InverseMass + B->InverseMass;
-                MassTangent += Dot(A->InverseInertia * Cross(Cross(RA, Tangent), RA) +
-                                   B->InverseInertia * Cross(Cross(RB, Tangent), RB),
-                                   Tangent);
-                MassTangent = 1.f / MassTangent;
-                float Vt = Dot(RelativeVelocity, Tangent);
-                float TangentImpulse = MassTangent * (-Vt);
-                float ImpulseClamp = Friction * Contact->NormalImpulse;
-                float TangentImpulse0 = Contact->FrictionImpulse;
-                Contact->FrictionImpulse = Clamp(TangentImpulse0 + TangentImpulse, -ImpulseClamp, ImpulseClamp);
-                TangentImpulse = Contact->FrictionImpulse - TangentImpulse0;
-                v3 P = TangentImpulse * Tangent;
+        for (i32 i = 0; i < WorkCount; ++i)
+        {
+            Residual = Max(Residual, Work[i].Residual);
+        }
+    }
+
+    for (i32 i = 0; i < World->OverflowConstraintCount; ++i)
+    {
+        Residual = Max(Residual, SolveContactConstraint(World->ContactConstraints + World->OverflowConstraints[i]));
+    }
+    return Residual;
+}
 
-                if (A->Type == RigidBodyType_Dynamic)
+// Moves the impulses of the batches back into the scalar constraints, so that
+// StoreContactImpulses works for both solvers.
+void StoreContactBatchImpulses(world *World)
+{
+    for (i32 BatchIndex = 0; BatchIndex < World->ContactBatchCount; ++BatchIndex)
+    {
+        contact_constraint_4x *Batch = World->ContactBatches + BatchIndex;
+        for (i32 i = 0; i < Batch->PointCount; ++i)
+        {
+            contact_constraint_point_4x *Point = Batch->Points + i;
+            alignas(16) float NormalImpulse[4];
+            alignas(16) float TangentImpulse[2][4];
+            StoreF32_4x(NormalImpulse, Point->NormalImpulse);
+            StoreF32_4x(TangentImpulse[0], Point->TangentImpulse[0]);
+            StoreF32_4x(TangentImpulse[1], Point->TangentImpulse[1]);
+            for (i32 Lane = 0; Lane < 4; ++Lane)
+            {
+                contact_constraint *Constraint = Batch->Constraints[Lane];
+                if (Constraint && i < Constraint->PointCount)
                 {
-                    A->LinearMomentum -= P;
-                    A->AngularMomentum -= Cross(RA, P);
-                    A->Recalculate();
+                    Constraint->Points[i].NormalImpulse = NormalImpulse[Lane];
+                    Constraint->Points[i].TangentImpulse[0] = TangentImpulse[0][Lane];
+                    Constraint->Points[i].TangentImpulse[1] = TangentImpulse[1][Lane];
                 }
+            }
+        }
 
-                if (B->Type == RigidBodyType_Dynamic)
+        if (Batch->UsePatchFriction)
+        {
+            alignas(16) float PatchImpulse[2][4];
+            alignas(16) float TwistImpulse[4];
+            StoreF32_4x(PatchImpulse[0], Batch->PatchImpulse[0]);
+            StoreF32_4x(PatchImpulse[1], Batch->PatchImpulse[1]);
+            StoreF32_4x(TwistImpulse, Batch->TwistImpulse);
+            for (i32 Lane = 0; Lane < 4; ++Lane)
+            {
+                contact_constraint *Constraint = Batch->Constraints[Lane];
+                if (Constraint)
                 {
-                    B->LinearMomentum += P;
-                    B->AngularMomentum += Cross(RB, P);
-                    B->Recalculate();
+                    Constraint->PatchImpulse[0] = PatchImpulse[0][Lane];
+                    Constraint->PatchImpulse[1] = PatchImpulse[1][Lane];
+                    Constraint->TwistImpulse = TwistImpulse[Lane];
                 }
             }
         }
     }
 }
 
+// Semi-implicit Euler, the poses are moved with the velocities the solver just produced.
+// Four bodies are transposed into the lanes and integrated together, the orientations are
+// renormalized right away instead of in the next Recalculate. The velocities are those
+// of the center of mass, so the lanes move the center and the origin follows it.
+void IntegrateBodies(world *World, float dt)
+{
+    i32 *Bodies = ArenaPushArray(TemporaryArena(), World->EntityCount, i32);
+    i32 BodyCount = 0;
+    for (i32 i = 1; i < World->EntityCount; ++i)
+    {
+        rigid_body *Entity = GetEntityByHandle(i);
+        if (Entity->Type == RigidBodyType_Dynamic && !Entity->IsSleeping)
+        {
+            Bodies[BodyCount++] = i;
+        }
+    }
+
+    f32_4x Step = F32_4x(dt);
+    f32_4x HalfStep = F32_4x(0.5f * dt);
+    for (i32 First = 0; First < BodyCount; First += 4)
+    {
+        // Empty lanes get the identity rotation so the normalization stays finite.
+        alignas(16) float Lanes[13][4] = {};
+        for (i32 Lane = 0; Lane < 4; ++Lane)
+        {
+            Lanes[3][Lane] = 1.f;
+            if (First + Lane < BodyCount)
+            {
+                rigid_body *Entity = GetEntityByHandle(Bodies[First + Lane]);
+                body_motion *Motion = GetBodyMotion(Bodies[First + Lane]);
+                transform Pose = World->Poses[Bodies[First + Lane]];
+                v3 Center = PointToWorldSpace(Entity->LocalCenterOfMass, Pose);
+                v3 LinearVelocity = Motion->LinearVelocity + Motion->BiasLinearVelocity;
+                v3 AngularVelocity = Motion->AngularVelocity + Motion->BiasAngularVelocity;
+                for (i32 k = 0; k < 3; ++k)
+                {
+                    Lanes[k][Lane] = Center[k];
+                    Lanes[4 + k][Lane] = Pose.Rotation.v[k];
+                    Lanes[7 + k][Lane] = LinearVelocity[k];
+                    Lanes[10 + k][Lane] = AngularVelocity[k];
+                }
+                Lanes[3][Lane] = Pose.Rotation.w;
+            }
+        }
+
+        v3_4x Center = {LoadF32_4x(Lanes[0]), LoadF32_4x(Lanes[1]), LoadF32_4x(Lanes[2])};
+        f32_4x OrientationW = LoadF32_4x(Lanes[3]);
+        v3_4x OrientationV = {LoadF32_4x(Lanes[4]), LoadF32_4x(Lanes[5]), LoadF32_4x(Lanes[6])};
+        v3_4x LinearVelocity = {LoadF32_4x(Lanes[7]), LoadF32_4x(Lanes[8]), LoadF32_4x(Lanes[9])};
+        v3_4x AngularVelocity = {LoadF32_4x(Lanes[10]), LoadF32_4x(Lanes[11]), LoadF32_4x(Lanes[12])};
+
+        Center = Center + LinearVelocity * Step;
+
+        // dq/dt = 0.5 * (0, w) * q
+        f32_4x NewW = OrientationW - Dot(AngularVelocity, OrientationV) * HalfStep;
+        v3_4x NewV = OrientationV + (AngularVelocity * OrientationW + Cross(AngularVelocity, OrientationV)) * HalfStep;
+        f32_4x InverseLength = F32_4x(1.f) / SquareRoot(NewW * NewW + Dot(NewV, NewV));
+        OrientationW = NewW * InverseLength;
+        OrientationV = NewV * InverseLength;
 
+        StoreF32_4x(Lanes[0], Center.x);
+        StoreF32_4x(Lanes[1], Center.y);
+        StoreF32_4x(Lanes[2], Center.z);
+        StoreF32_4x(Lanes[3], OrientationW);
+        StoreF32_4x(Lanes[4], OrientationV.x);
+        StoreF32_4x(Lanes[5], OrientationV.y);
+        StoreF32_4x(Lanes[6], OrientationV.z);
+        for (i32 Lane = 0; Lane < 4 && First + Lane < BodyCount; ++Lane)
+        {
+            rigid_body *Entity = GetEntityByHandle(Bodies[First + Lane]);
+            v3 BodyCenter = V3(Lanes[0][Lane], Lanes[1][Lane], Lanes[2][Lane]);
+            quaternion Orientation;
+            Orientation.w = Lanes[3][Lane];
+            Orientation.v = V3(Lanes[4][Lane], Lanes[5][Lane], Lanes[6][Lane]);
+            SetBodyPose(Bodies[First + Lane], BodyCenter - RotateVector(Entity->LocalCenterOfMass, Orientation), Orientation);
+        }
+    }
+}
@@ -3,6 +3,7 @@
 
 #include "common.h"
 #include "mathlib.h"
+#include "simd.h"
 #include "geometry.h"
 #include "main.h"
 #include "renderer.h"
@@ -12,6 +13,10 @@
 
 #include "bvh.cpp"
 #include "geometry.cpp"
+#include "quickhull.cpp"
+#include "compound.cpp"
+#include "triangle_mesh.cpp"
+#include "heightfield.cpp"
 #include "physics.cpp"
 #include "main.cpp"
 #include "renderer_dx11.cpp"
@@ -48,6 +53,93 @@ void PlatformReleaseMemory(void *memory)
     VirtualFree(memory, 0, MEM_RELEASE);
 }
 
+struct win32_work_entry
+{
+    work_queue_callback *Callback;
+    void *Data;
+};
+
+// Single producer ring buffer, only the main thread adds work.
+static struct
+{
+    volatile LONG CompletionGoal;
+    volatile LONG CompletionCount;
+    volatile LONG NextEntryToWrite;
+    volatile LONG NextEntryToRead;
+    HANDLE Semaphore;
+    win32_work_entry Entries[256];
+} WorkQueue;
+
+void PlatformAddWork(work_queue_callback *Callback, void *Data)
+{
+    LONG NewNextEntryToWrite = (WorkQueue.NextEntryToWrite + 1) % ARRAY_SIZE(WorkQueue.Entries);
+    ASSERT(NewNextEntryToWrite != WorkQueue.NextEntryToRead);
+    win32_work_entry *Entry = WorkQueue.Entries + WorkQueue.NextEntryToWrite;
+    Entry->Callback = Callback;
+    Entry->Data = Data;
+    WorkQueue.CompletionGoal++;
+    MemoryBarrier();
+    WorkQueue.NextEntryToWrite = NewNextEntryToWrite;
+    ReleaseSemaphore(WorkQueue.Semaphore, 1, 0);
+}
+
+// Returns false if there was nothing to do.
+static bool Win32DoNextWorkEntry()
+{
+    LONG OriginalNextEntryToRead = WorkQueue.NextEntryToRead;
+    if (OriginalNextEntryToRead == WorkQueue.NextEntryToWrite)
+    {
+        return false;
+    }
+
+    LONG NewNextEntryToRead = (OriginalNextEntryToRead + 1) % ARRAY_SIZE(WorkQueue.Entries);
+    LONG Index = InterlockedCompareExchange(&WorkQueue.NextEntryToRead,
+                                            NewNextEntryToRead,
+                                            OriginalNextEntryToRead);
+    if (Index == OriginalNextEntryToRead)
+    {
+        win32_work_entry Entry = WorkQueue.Entries[Index];
+        Entry.Callback(Entry.Data);
+        InterlockedIncrement(&WorkQueue.CompletionCount);
+    }
+    return true;
+}
+
+void PlatformCompleteAllWork()
+{
+    while (WorkQueue.CompletionGoal != WorkQueue.CompletionCount)
+    {
+        Win32DoNextWorkEntry();
+    }
+    WorkQueue.CompletionGoal = 0;
+    WorkQueue.CompletionCount = 0;
+}
+
+DWORD WINAPI Win32WorkerThread(LPVOID)
+{
+    for (;;)
+    {
+        if (!Win32DoNextWorkEntry())
+        {
+            WaitForSingleObjectEx(WorkQueue.Semaphore, INFINITE, FALSE);
+        }
+    }
+}
+
+static void Win32InitWorkQueue()
+{
+    SYSTEM_INFO SystemInfo;
+    GetSystemInfo(&SystemInfo);
+    i32 WorkerCount = (i32)SystemInfo.dwNumberOfProcessors - 1;
+
+    WorkQueue.Semaphore = CreateSemaphoreEx(0, 0, ARRAY_SIZE(WorkQueue.Entries), 0, 0, SEMAPHORE_ALL_ACCESS);
+    for (i32 i = 0; i < WorkerCount; ++i)
+    {
+        HANDLE Thread = CreateThread(0, 0, Win32WorkerThread, 0, 0, 0);
+        CloseHandle(Thread);
+    }
+}
+
 LRESULT Win32WindowProc(HWND window, UINT msg, WPARAM wparam, LPARAM lparam)
 {
     LRESULT result = 0;
@@ -73,6 +165,7 @@ int WinMain(HINSTANCE instance, HINSTANCE, LPSTR, int)
 {
     LARGE_INTEGER PerformanceFrequency;
     QueryPerformanceFrequency(&PerformanceFrequency);
+    Win32InitWorkQueue();
 
     WNDCLASSEXA window_class = {};
     window_class.cbSize = sizeof(WNDCLASSEXA);
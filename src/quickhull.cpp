@@ -0,0 +1,766 @@
+//
+// Quickhull as described in [6], builds a hull from an arbitrary point cloud.
+//
+// The hull is first built as a triangle mesh where every face keeps a conflict list of
+// the points in front of it. Afterwards coplanar triangles are merged into polygons and
+// the result is converted to the half edge representation used by the SAT code.
+//
+
+struct qh_face
+{
+    i32 Vertices[3];
+    // Face on the other side of the edge Vertices[i] -> Vertices[(i+1)%3].
+    i32 Adjacent[3];
+    plane Plane;
+
+    // Linked list (through qh_builder::NextConflict) of points in front of this face.
+    i32 ConflictList;
+    i32 FurthestPoint;
+    float FurthestDistance;
+
+    i32 VisitedStamp;
+    bool IsAlive;
+};
+
+struct qh_horizon_edge
+{
+    i32 Face;
+    i32 Edge;
+};
+
+struct qh_builder
+{
+    i32 PointCount;
+    v3 *Points;
+    i32 *NextConflict;
+    float Epsilon;
+
+    i32 MaxFaces;
+    i32 FaceCount;
+    qh_face *Faces;
+    i32 *FreeFaces;
+    i32 *PendingFaces;
+
+    i32 VisitedStamp;
+    i32 *Visible;
+    qh_horizon_edge *Horizon;
+    i32 *NewFaces;
+    i32 *HorizonStartFace;
+    i32 *HorizonEndFace;
+};
+
+static i32 QHAllocateFace(qh_builder *Builder, i32 A, i32 B, i32 C)
+{
+    i32 FaceIndex;
+    if (ListLength(Builder->FreeFaces) > 0)
+    {
+        FaceIndex = ListPop(Builder->FreeFaces);
+    }
+    else
+    {
+        ASSERT(Builder->FaceCount < Builder->MaxFaces);
+        FaceIndex = Builder->FaceCount++;
+    }
+
+    qh_face *Face = Builder->Faces + FaceIndex;
+    *Face = {};
+    Face->Vertices[0] = A;
+    Face->Vertices[1] = B;
+    Face->Vertices[2] = C;
+    Face->Adjacent[0] = Face->Adjacent[1] = Face->Adjacent[2] = -1;
+    Face->Plane = PlaneFromPoints(Builder->Points[A], Builder->Points[B], Builder->Points[C]);
+    Face->ConflictList = -1;
+    Face->FurthestPoint = -1;
+    Face->FurthestDistance = 0.f;
+    Face->IsAlive = true;
+    return FaceIndex;
+}
+
+static void QHPushPending(qh_builder *Builder, i32 FaceIndex)
+{
+    if (ListLength(Builder->PendingFaces) == ListCapacity(Builder->PendingFaces))
+    {
+        // Drop entries for faces that have died or been resolved since they were pushed.
+        usize Length = 0;
+        for (usize i = 0; i < ListLength(Builder->PendingFaces); ++i)
+        {
+            qh_face *Face = Builder->Faces + Builder->PendingFaces[i];
+            if (Face->IsAlive && Face->ConflictList != -1)
+            {
+                Builder->PendingFaces[Length++] = Builder->PendingFaces[i];
+            }
+        }
+        ListHeader(Builder->PendingFaces)->Length = Length;
+    }
+    ListPush(Builder->PendingFaces, FaceIndex);
+}
+
+// Adds the point to the conflict list of the face it is furthest in front of, points
+// that are not in front of any face are inside the hull and get discarded.
+static void QHAssignPoint(qh_builder *Builder, i32 PointIndex, i32 *Faces, i32 FaceCount)
+{
+    v3 Point = Builder->Points[PointIndex];
+    i32 BestFace = -1;
+    float BestDistance = Builder->Epsilon;
+    for (i32 i = 0; i < FaceCount; ++i)
+    {
+        float Distance = SignedDistance(Builder->Faces[Faces[i]].Plane, Point);
+        if (Distance > BestDistance)
+        {
+            BestDistance = Distance;
+            BestFace = Faces[i];
+        }
+    }
+
+    if (BestFace != -1)
+    {
+        qh_face *Face = Builder->Faces + BestFace;
+        Builder->NextConflict[PointIndex] = Face->ConflictList;
+        Face->ConflictList = PointIndex;
+        if (BestDistance > Face->FurthestDistance)
+        {
+            Face->FurthestDistance = BestDistance;
+            Face->FurthestPoint = PointIndex;
+        }
+    }
+}
+
+static bool QHBuildInitialSimplex(qh_builder *Builder)
+{
+    v3 *Points = Builder->Points;
+
+    i32 Extremes[6] = {};
+    for (i32 i = 0; i < Builder->PointCount; ++i)
+    {
+        for (i32 Axis = 0; Axis < 3; ++Axis)
+        {
+            if (Points[i][Axis] < Points[Extremes[2*Axis]][Axis])     Extremes[2*Axis] = i;
+            if (Points[i][Axis] > Points[Extremes[2*Axis + 1]][Axis]) Extremes[2*Axis + 1] = i;
+        }
+    }
+
+    // The two extreme points furthest apart.
+    i32 I0 = 0, I1 = 0;
+    float MaxDistanceSq = -1.f;
+    for (i32 i = 0; i < 6; ++i)
+    {
+        for (i32 j = i+1; j < 6; ++j)
+        {
+            float DistanceSq = LengthSquared(Points[Extremes[i]] - Points[Extremes[j]]);
+            if (DistanceSq > MaxDistanceSq)
+            {
+                MaxDistanceSq = DistanceSq;
+                I0 = Extremes[i];
+                I1 = Extremes[j];
+            }
+        }
+    }
+
+    if (MaxDistanceSq <= Square(Builder->Epsilon))
+    {
+        return false;
+    }
+
+    // The point furthest away from the line.
+    i32 I2 = -1;
+    v3 Line = Points[I1] - Points[I0];
+    MaxDistanceSq = Square(Builder->Epsilon) * LengthSquared(Line);
+    for (i32 i = 0; i < Builder->PointCount; ++i)
+    {
+        float DistanceSq = LengthSquared(Cross(Points[i] - Points[I0], Line));
+        if (DistanceSq > MaxDistanceSq)
+        {
+            MaxDistanceSq = DistanceSq;
+            I2 = i;
+        }
+    }
+
+    if (I2 == -1)
+    {
+        return false;
+    }
+
+    // The point furthest away from the plane.
+    i32 I3 = -1;
+    plane Plane = PlaneFromPoints(Points[I0], Points[I1], Points[I2]);
+    float MaxDistance = Builder->Epsilon;
+    for (i32 i = 0; i < Builder->PointCount; ++i)
+    {
+        float Distance = fabsf(SignedDistance(Plane, Points[i]));
+        if (Distance > MaxDistance)
+        {
+            MaxDistance = Distance;
+            I3 = i;
+        }
+    }
+
+    if (I3 == -1)
+    {
+        return false;
+    }
+
+    i32 Tetrahedron[4][4] = {
+        {I0, I1, I2, I3},
+        {I0, I3, I1, I2},
+        {I1, I3, I2, I0},
+        {I2, I3, I0, I1},
+    };
+
+    i32 Faces[4];
+    for (i32 i = 0; i < 4; ++i)
+    {
+        i32 *T = Tetrahedron[i];
+        plane FacePlane = PlaneFromPoints(Points[T[0]], Points[T[1]], Points[T[2]]);
+        if (SignedDistance(FacePlane, Points[T[3]]) > 0.f)
+        {
+            // Wind the face so that the opposite vertex is behind it.
+            i32 Temp = T[1];
+            T[1] = T[2];
+            T[2] = Temp;
+        }
+        Faces[i] = QHAllocateFace(Builder, T[0], T[1], T[2]);
+    }
+
+    for (i32 i = 0; i < 4; ++i)
+    {
+        qh_face *Face = Builder->Faces + Faces[i];
+        for (i32 Edge = 0; Edge < 3; ++Edge)
+        {
+            i32 A = Face->Vertices[Edge];
+            i32 B = Face->Vertices[(Edge + 1) % 3];
+            for (i32 j = 0; j < 4; ++j)
+            {
+                qh_face *Other = Builder->Faces + Faces[j];
+                for (i32 OtherEdge = 0; OtherEdge < 3; ++OtherEdge)
+                {
+                    if (Other->Vertices[OtherEdge] == B &&
+                        Other->Vertices[(OtherEdge + 1) % 3] == A)
+                    {
+                        Face->Adjacent[Edge] = Faces[j];
+                    }
+                }
+            }
+            ASSERT(Face->Adjacent[Edge] != -1);
+        }
+    }
+
+    for (i32 i = 0; i < Builder->PointCount; ++i)
+    {
+        if (i != I0 && i != I1 && i != I2 && i != I3)
+        {
+            QHAssignPoint(Builder, i, Faces, 4);
+        }
+    }
+
+    for (i32 i = 0; i < 4; ++i)
+    {
+        if (Builder->Faces[Faces[i]].ConflictList != -1)
+        {
+            QHPushPending(Builder, Faces[i]);
+        }
+    }
+
+    return true;
+}
+
+static void QHAddPoint(qh_builder *Builder, i32 FaceIndex)
+{
+    qh_face *Faces = Builder->Faces;
+    i32 Eye = Faces[FaceIndex].FurthestPoint;
+    v3 EyePoint = Builder->Points[Eye];
+
+    ListHeader(Builder->Visible)->Length = 0;
+    ListHeader(Builder->Horizon)->Length = 0;
+    ListHeader(Builder->NewFaces)->Length = 0;
+
+    // Flood fill the faces the eye point can see, the edges to the faces it can't see
+    // form the horizon.
+    i32 Stamp = ++Builder->VisitedStamp;
+    Faces[FaceIndex].VisitedStamp = Stamp;
+    ListPush(Builder->Visible, FaceIndex);
+    for (usize VisibleIndex = 0; VisibleIndex < ListLength(Builder->Visible); ++VisibleIndex)
+    {
+        i32 Current = Builder->Visible[VisibleIndex];
+        for (i32 Edge = 0; Edge < 3; ++Edge)
+        {
+            i32 Neighbour = Faces[Current].Adjacent[Edge];
+            if (Faces[Neighbour].VisitedStamp == Stamp)
+            {
+                continue;
+            }
+
+            if (SignedDistance(Faces[Neighbour].Plane, EyePoint) > Builder->Epsilon)
+            {
+                Faces[Neighbour].VisitedStamp = Stamp;
+                ListPush(Builder->Visible, Neighbour);
+            }
+            else
+            {
+                ListPush(Builder->Horizon, (qh_horizon_edge{Current, Edge}));
+            }
+        }
+    }
+
+    // Connect every horizon edge to the eye point.
+    for (usize i = 0; i < ListLength(Builder->Horizon); ++i)
+    {
+        qh_horizon_edge HorizonEdge = Builder->Horizon[i];
+        i32 A = Faces[HorizonEdge.Face].Vertices[HorizonEdge.Edge];
+        i32 B = Faces[HorizonEdge.Face].Vertices[(HorizonEdge.Edge + 1) % 3];
+        i32 Outside = Faces[HorizonEdge.Face].Adjacent[HorizonEdge.Edge];
+
+        i32 NewFace = QHAllocateFace(Builder, A, B, Eye);
+        Faces[NewFace].Adjacent[0] = Outside;
+        for (i32 Edge = 0; Edge < 3; ++Edge)
+        {
+            if (Faces[Outside].Adjacent[Edge] == HorizonEdge.Face &&
+                Faces[Outside].Vertices[Edge] == B)
+            {
+                Faces[Outside].Adjacent[Edge] = NewFace;
+            }
+        }
+
+        Builder->HorizonStartFace[A] = NewFace;
+        Builder->HorizonEndFace[B] = NewFace;
+        ListPush(Builder->NewFaces, NewFace);
+    }
+
+    // The new faces form a cone, link up their sides.
+    for (usize i = 0; i < ListLength(Builder->NewFaces); ++i)
+    {
+        qh_face *Face = Faces + Builder->NewFaces[i];
+        Face->Adjacent[1] = Builder->HorizonStartFace[Face->Vertices[1]];
+        Face->Adjacent[2] = Builder->HorizonEndFace[Face->Vertices[0]];
+    }
+
+    // Hand over the orphaned points to the new faces and retire the visible ones.
+    for (usize i = 0; i < ListLength(Builder->Visible); ++i)
+    {
+        qh_face *Face = Faces + Builder->Visible[i];
+        i32 PointIndex = Face->ConflictList;
+        while (PointIndex != -1)
+        {
+            i32 Next = Builder->NextConflict[PointIndex];
+            if (PointIndex != Eye)
+            {
+                QHAssignPoint(Builder, PointIndex, Builder->NewFaces, (i32)ListLength(Builder->NewFaces));
+            }
+            PointIndex = Next;
+        }
+
+        Face->IsAlive = false;
+        Face->ConflictList = -1;
+    }
+
+    for (usize i = 0; i < ListLength(Builder->Visible); ++i)
+    {
+        ListPush(Builder->FreeFaces, Builder->Visible[i]);
+    }
+
+    for (usize i = 0; i < ListLength(Builder->NewFaces); ++i)
+    {
+        if (Faces[Builder->NewFaces[i]].ConflictList != -1)
+        {
+            QHPushPending(Builder, Builder->NewFaces[i]);
+        }
+    }
+}
+
+struct mass_properties
+{
+    float Volume;
+    v3 Centroid;
+    // Inertia tensor about the centroid, for a density of 1.
+    m3x3 Inertia;
+};
+
+// Sums up the tetrahedra formed by a fan triangulation of every face and a reference
+// point inside the hull, using the covariance method from Blow and Binstock.
+mass_properties ComputeHullMassProperties(hull *Hull)
+{
+    mass_properties Result = {};
+
+    v3 Reference = {};
+    for (i32 i = 0; i < Hull->VertexCount; ++i)
+    {
+        Reference += Hull->Vertices[i];
+    }
+    Reference = Reference / (float)Hull->VertexCount;
+
+    float Covariance[3][3] = {};
+    v3 WeightedCentroid = {};
+    for (i32 FaceIndex = 0; FaceIndex < Hull->FaceCount; ++FaceIndex)
+    {
+        half_edge *Edge0 = Hull->Edges + Hull->Faces[FaceIndex].Edge;
+        half_edge *Edge1 = Hull->Edges + Edge0->Next;
+        half_edge *Edge2 = Hull->Edges + Edge1->Next;
+        v3 A = Hull->Vertices[Edge0->Origin] - Reference;
+        while (Edge2 != Edge0)
+        {
+            v3 B = Hull->Vertices[Edge1->Origin] - Reference;
+            v3 C = Hull->Vertices[Edge2->Origin] - Reference;
+
+            float Det = Dot(A, Cross(B, C));
+            float Volume = Det / 6.f;
+            Result.Volume += Volume;
+            WeightedCentroid += (A + B + C) * (Volume / 4.f);
+
+            // Covariance of the tetrahedron (Reference, A, B, C), relative to Reference.
+            for (i32 i = 0; i < 3; ++i)
+            {
+                for (i32 j = 0; j < 3; ++j)
+                {
+                    Covariance[i][j] += Det / 120.f * (
+                        2.f * (A[i]*A[j] + B[i]*B[j] + C[i]*C[j]) +
+                        A[i]*B[j] + A[j]*B[i] +
+                        A[i]*C[j] + A[j]*C[i] +
+                        B[i]*C[j] + B[j]*C[i]);
+                }
+            }
+
+            Edge1 = Edge2;
+            Edge2 = Hull->Edges + Edge2->Next;
+        }
+    }
+
+    if (Result.Volume <= 0.f)
+    {
+        return Result;
+    }
+
+    v3 Centroid = WeightedCentroid / Result.Volume;
+    Result.Centroid = Centroid + Reference;
+
+    // Shift the covariance to the centroid and convert it to an inertia tensor.
+    float Trace = 0.f;
+    for (i32 i = 0; i < 3; ++i)
+    {
+        for (i32 j = 0; j < 3; ++j)
+        {
+            Covariance[i][j] -= Result.Volume * Centroid[i] * Centroid[j];
+        }
+        Trace += Covariance[i][i];
+    }
+
+    for (i32 i = 0; i < 3; ++i)
+    {
+        for (i32 j = 0; j < 3; ++j)
+        {
+            Result.Inertia[i][j] = (i == j ? Trace : 0.f) - Covariance[i][j];
+        }
+    }
+
+    return Result;
+}
+
+// Converts the triangles left alive by quickhull to a hull, merging coplanar triangles
+// into polygons on the way.
+static hull *QHBuildHull(qh_builder *Builder, arena *Arena)
+{
+    arena *Scratch = TemporaryArena();
+    qh_face *Faces = Builder->Faces;
+
+    i32 *Groups = ArenaPushArray(Scratch, Builder->FaceCount, i32);
+    i32 *GroupFaces = ArenaPushList(Scratch, Builder->FaceCount, i32);
+    i32 *Stack = ArenaPushList(Scratch, Builder->FaceCount, i32);
+    for (i32 i = 0; i < Builder->FaceCount; ++i)
+    {
+        Groups[i] = -1;
+    }
+
+    // Polygons are stored back to back in PolygonVertices.
+    i32 PolygonCount = 0;
+    i32 *PolygonStart = ArenaPushArray(Scratch, Builder->FaceCount + 1, i32);
+    i32 *PolygonVertices = ArenaPushArray(Scratch, Builder->FaceCount * 3, i32);
+    i32 *NextBoundaryVertex = ArenaPushArray(Scratch, Builder->PointCount, i32);
+
+    float MergeDistance = 2.f * Builder->Epsilon;
+    for (i32 Seed = 0; Seed < Builder->FaceCount; ++Seed)
+    {
+        if (!Faces[Seed].IsAlive || Groups[Seed] != -1)
+        {
+            continue;
+        }
+
+        // Grow the group from the seed, testing against the seed plane so that slowly
+        // curving surfaces don't get merged into one face.
+        i32 Group = Seed;
+        plane SeedPlane = Faces[Seed].Plane;
+        ListHeader(GroupFaces)->Length = 0;
+        ListPush(Stack, Seed);
+        Groups[Seed] = Group;
+        while (ListLength(Stack) != 0)
+        {
+            i32 Current = ListPop(Stack);
+            ListPush(GroupFaces, Current);
+            for (i32 Edge = 0; Edge < 3; ++Edge)
+            {
+                i32 Neighbour = Faces[Current].Adjacent[Edge];
+                if (Groups[Neighbour] != -1 ||
+                    Dot(Faces[Neighbour].Plane.Normal, SeedPlane.Normal) < 0.f)
+                {
+                    continue;
+                }
+
+                bool Coplanar = true;
+                for (i32 i = 0; i < 3; ++i)
+                {
+                    v3 Vertex = Builder->Points[Faces[Neighbour].Vertices[i]];
+                    if (fabsf(SignedDistance(SeedPlane, Vertex)) > MergeDistance)
+                    {
+                        Coplanar = false;
+                    }
+                }
+
+                if (Coplanar)
+                {
+                    Groups[Neighbour] = Group;
+                    ListPush(Stack, Neighbour);
+                }
+            }
+        }
+
+        // Walk the boundary of the group to get the polygon.
+        i32 BoundaryCount = 0;
+        i32 StartVertex = -1;
+        for (usize i = 0; i < ListLength(GroupFaces); ++i)
+        {
+            qh_face *Face = Faces + GroupFaces[i];
+            for (i32 Edge = 0; Edge < 3; ++Edge)
+            {
+                if (Groups[Face->Adjacent[Edge]] != Group)
+                {
+                    NextBoundaryVertex[Face->Vertices[Edge]] = Face->Vertices[(Edge + 1) % 3];
+                    StartVertex = Face->Vertices[Edge];
+                    BoundaryCount++;
+                }
+            }
+        }
+
+        i32 Start = PolygonStart[PolygonCount];
+        i32 Count = 0;
+        i32 Vertex = StartVertex;
+        do
+        {
+            PolygonVertices[Start + Count++] = Vertex;
+            Vertex = NextBoundaryVertex[Vertex];
+        }
+        while (Vertex != StartVertex && Count <= BoundaryCount);
+
+        if (Count == BoundaryCount)
+        {
+            PolygonStart[++PolygonCount] = Start + Count;
+        }
+        else
+        {
+            // The boundary isn't a single loop, keep the triangles as they are.
+            for (usize i = 0; i < ListLength(GroupFaces); ++i)
+            {
+                qh_face *Face = Faces + GroupFaces[i];
+                Start = PolygonStart[PolygonCount];
+                for (i32 j = 0; j < 3; ++j)
+                {
+                    PolygonVertices[Start + j] = Face->Vertices[j];
+                }
+                PolygonStart[++PolygonCount] = Start + 3;
+            }
+        }
+    }
+
+    // Vertices that ended up on the edge between two merged faces are redundant, unless
+    // removing them would collapse a triangle.
+    i32 *FaceUseCount = ArenaPushArray(Scratch, Builder->PointCount, i32);
+    for (i32 Polygon = 0; Polygon < PolygonCount; ++Polygon)
+    {
+        i32 Start = PolygonStart[Polygon];
+        i32 End = PolygonStart[Polygon + 1];
+        for (i32 i = Start; i < End; ++i)
+        {
+            FaceUseCount[PolygonVertices[i]] += (End - Start) > 3 ? 1 : 3;
+        }
+    }
+
+    i32 *VertexRemap = NextBoundaryVertex;
+    for (i32 i = 0; i < Builder->PointCount; ++i)
+    {
+        VertexRemap[i] = -1;
+    }
+
+    i32 VertexCount = 0;
+    i32 IndexCount = 0;
+    for (i32 Polygon = 0; Polygon < PolygonCount; ++Polygon)
+    {
+        i32 Start = PolygonStart[Polygon];
+        i32 End = PolygonStart[Polygon + 1];
+        PolygonStart[Polygon] = IndexCount;
+        for (i32 i = Start; i < End; ++i)
+        {
+            i32 Vertex = PolygonVertices[i];
+            if (FaceUseCount[Vertex] < 3)
+            {
+                continue;
+            }
+
+            if (VertexRemap[Vertex] == -1)
+            {
+                VertexRemap[Vertex] = VertexCount++;
+            }
+            PolygonVertices[IndexCount++] = Vertex;
+        }
+    }
+    PolygonStart[PolygonCount] = IndexCount;
+
+    ASSERT(IndexCount < 0xFFFF);
+
+    hull *Result = ArenaPushType(Arena, hull);
+    Result->VertexCount = VertexCount;
+    Result->EdgeCount = IndexCount;
+    Result->FaceCount = PolygonCount;
+    Result->Vertices = ArenaPushArray(Arena, Result->VertexCount, v3);
+    Result->Edges = ArenaPushArray(Arena, Result->EdgeCount, half_edge);
+    Result->Faces = ArenaPushArray(Arena, Result->FaceCount, face);
+    Result->Planes = ArenaPushArray(Arena, Result->FaceCount, plane);
+
+    for (i32 i = 0; i < Builder->PointCount; ++i)
+    {
+        if (VertexRemap[i] != -1)
+        {
+            Result->Vertices[VertexRemap[i]] = Builder->Points[i];
+        }
+    }
+
+    // Twin half edges are stored next to each other, so every undirected edge gets a
+    // pair index from a small hash map keyed on its two vertices.
+    u32 MapSize = 1;
+    while (MapSize < (u32)IndexCount * 2)
+    {
+        MapSize <<= 1;
+    }
+    u64 *MapKeys = ArenaPushArray(Scratch, MapSize, u64);
+    i32 *MapPairs = ArenaPushArray(Scratch, MapSize, i32);
+    i32 PairCount = 0;
+
+    for (i32 Polygon = 0; Polygon < PolygonCount; ++Polygon)
+    {
+        i32 Start = PolygonStart[Polygon];
+        i32 Count = PolygonStart[Polygon + 1] - Start;
+        i32 FirstEdge = -1;
+        i32 PreviousEdge = -1;
+        v3 Normal = {};
+        v3 Center = {};
+        for (i32 i = 0; i < Count; ++i)
+        {
+            i32 A = VertexRemap[PolygonVertices[Start + i]];
+            i32 B = VertexRemap[PolygonVertices[Start + (i + 1) % Count]];
+
+            // Newell's method for the face normal.
+            v3 VA = Result->Vertices[A];
+            v3 VB = Result->Vertices[B];
+            Normal.x += (VA.y - VB.y) * (VA.z + VB.z);
+            Normal.y += (VA.z - VB.z) * (VA.x + VB.x);
+            Normal.z += (VA.x - VB.x) * (VA.y + VB.y);
+            Center += VA;
+
+            u64 Key = ((u64)(A < B ? A : B) << 32) | (u64)(A < B ? B : A);
+            u32 Slot = (u32)((Key * 0x9E3779B97F4A7C15ull) >> 32) & (MapSize - 1);
+            while (MapKeys[Slot] != 0 && MapKeys[Slot] != Key + 1)
+            {
+                Slot = (Slot + 1) & (MapSize - 1);
+            }
+
+            i32 EdgeIndex;
+            if (MapKeys[Slot] == 0)
+            {
+                MapKeys[Slot] = Key + 1;
+                MapPairs[Slot] = PairCount++;
+                EdgeIndex = 2 * MapPairs[Slot];
+            }
+            else
+            {
+                EdgeIndex = 2 * MapPairs[Slot] + 1;
+            }
+
+            half_edge *Edge = Result->Edges + EdgeIndex;
+            Edge->Origin = (u16)A;
+            Edge->Twin = (u16)(EdgeIndex ^ 1);
+            Edge->Face = (u16)Polygon;
+
+            if (PreviousEdge != -1)
+            {
+                Result->Edges[PreviousEdge].Next = (u16)EdgeIndex;
+            }
+            else
+            {
+                FirstEdge = EdgeIndex;
+            }
+            PreviousEdge = EdgeIndex;
+        }
+        Result->Edges[PreviousEdge].Next = (u16)FirstEdge;
+        Result->Faces[Polygon].Edge = (u16)FirstEdge;
+        Result->Planes[Polygon] = PlaneFromVectorAndPoint(Normal, Center / (float)Count);
+    }
+
+    ASSERT(2 * PairCount == Result->EdgeCount);
+
+    mass_properties MassProperties = ComputeHullMassProperties(Result);
+    Result->Centroid = MassProperties.Centroid;
+    return Result;
+}
+
+// Returns NULL if the points are degenerate (all coplanar, collinear or coincident).
+hull *QuickHull(arena *Arena, v3 *Points, i32 PointCount)
+{
+    if (PointCount < 4)
+    {
+        return NULL;
+    }
+
+    temporary_memory Temp = BeginTemporaryMemory(TemporaryArena());
+    arena *Scratch = TemporaryArena();
+
+    qh_builder Builder = {};
+    Builder.PointCount = PointCount;
+    Builder.Points = Points;
+    Builder.NextConflict = ArenaPushArray(Scratch, PointCount, i32);
+
+    v3 MaxAbs = {};
+    for (i32 i = 0; i < PointCount; ++i)
+    {
+        for (i32 Axis = 0; Axis < 3; ++Axis)
+        {
+            MaxAbs[Axis] = Max(MaxAbs[Axis], fabsf(Points[i][Axis]));
+        }
+    }
+    Builder.Epsilon = 3.f * FLT_EPSILON * (MaxAbs.x + MaxAbs.y + MaxAbs.z);
+
+    // A hull with V vertices has at most 2V - 4 faces, and a single step adds at most as
+    // many new faces as there are vertices on the horizon.
+    Builder.MaxFaces = 3 * PointCount + 8;
+    Builder.Faces = ArenaPushArray(Scratch, Builder.MaxFaces, qh_face);
+    Builder.FreeFaces = ArenaPushList(Scratch, Builder.MaxFaces, i32);
+    Builder.PendingFaces = ArenaPushList(Scratch, Builder.MaxFaces + PointCount, i32);
+    Builder.Visible = ArenaPushList(Scratch, Builder.MaxFaces, i32);
+    Builder.Horizon = ArenaPushList(Scratch, Builder.MaxFaces, qh_horizon_edge);
+    Builder.NewFaces = ArenaPushList(Scratch, Builder.MaxFaces, i32);
+    Builder.HorizonStartFace = ArenaPushArray(Scratch, PointCount, i32);
+    Builder.HorizonEndFace = ArenaPushArray(Scratch, PointCount, i32);
+
+    hull *Result = NULL;
+    if (QHBuildInitialSimplex(&Builder))
+    {
+        while (ListLength(Builder.PendingFaces) != 0)
+        {
+            i32 FaceIndex = ListPop(Builder.PendingFaces);
+            qh_face *Face = Builder.Faces + FaceIndex;
+            if (Face->IsAlive && Face->ConflictList != -1)
+            {
+                QHAddPoint(&Builder, FaceIndex);
+            }
+        }
+
+        Result = QHBuildHull(&Builder, Arena);
+    }
+
+    EndTemporaryMemory(Temp);
+    return Result;
+}
@@ -5,6 +5,8 @@ enum render_command_type
     RenderCommandType_AABB,
 
     DEBUG_RenderCommandType_Hull,
+    DEBUG_RenderCommandType_TriangleMesh,
+    DEBUG_RenderCommandType_Heightfield,
     DEBUG_RenderCommandType_BVH,
 
     RenderCommandType_MAX,
@@ -17,6 +19,24 @@ struct render_command_aabb
     v3 Color;
 };
 
+struct render_command_hull
+{
+    hull *Hull;
+    transform Transform;
+};
+
+struct render_command_triangle_mesh
+{
+    triangle_mesh *Mesh;
+    transform Transform;
+};
+
+struct render_command_heightfield
+{
+    heightfield *Heightfield;
+    transform Transform;
+};
+
 struct render_command
 {
     render_command_type Type;
@@ -25,7 +45,9 @@ struct render_command
         sphere Sphere;
         render_command_aabb AABB;
 
-        hull *DEBUGHull;
+        render_command_hull DEBUGHull;
+        render_command_triangle_mesh DEBUGTriangleMesh;
+        render_command_heightfield DEBUGHeightfield;
         bvh_tree *DEBUGBVHTree;
     };
 };
@@ -60,10 +82,25 @@ inline void PushAABB(render_group *Group, aabb AABB, transform Transform, v3 Col
     Cmd->AABB.Color = Color;
 }
 
-inline void DEBUGPushHull(render_group *Group, hull *Hull)
+inline void DEBUGPushHull(render_group *Group, hull *Hull, transform Transform)
 {
     render_command *Cmd = PushRenderCommand(Group, DEBUG_RenderCommandType_Hull);
-    Cmd->DEBUGHull = Hull;
+    Cmd->DEBUGHull.Hull = Hull;
+    Cmd->DEBUGHull.Transform = Transform;
+}
+
+inline void DEBUGPushTriangleMesh(render_group *Group, triangle_mesh *Mesh, transform Transform)
+{
+    render_command *Cmd = PushRenderCommand(Group, DEBUG_RenderCommandType_TriangleMesh);
+    Cmd->DEBUGTriangleMesh.Mesh = Mesh;
+    Cmd->DEBUGTriangleMesh.Transform = Transform;
+}
+
+inline void DEBUGPushHeightfield(render_group *Group, heightfield *Heightfield, transform Transform)
+{
+    render_command *Cmd = PushRenderCommand(Group, DEBUG_RenderCommandType_Heightfield);
+    Cmd->DEBUGHeightfield.Heightfield = Heightfield;
+    Cmd->DEBUGHeightfield.Transform = Transform;
 }
 
 inline void DEBUGPushBVHVis(render_group *Group, bvh_tree *Tree)
@@ -493,6 +493,9 @@ void RendererDrawFrame(render_group *RenderGroup)
             {
                 Renderer.Context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_LINELIST);
 
+                ConstantBuffer.Model =
+                    Translation(Cmd->DEBUGHull.Transform.Position) *
+                    RotationMatrix(Cmd->DEBUGHull.Transform.Rotation);
                 ConstantBuffer.ViewProjection = ViewProjection;
                 DXLoadConstantBuffer(&ConstantBuffer);
 
@@ -500,7 +503,7 @@ void RendererDrawFrame(render_group *RenderGroup)
                 DX_MAP(Renderer.Context, Renderer.HullVertexBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &Subresource)
                 {
                     vertex *Buffer = (vertex*)Subresource.pData;
-                    hull *Hull = Cmd->DEBUGHull;
+                    hull *Hull = Cmd->DEBUGHull.Hull;
 
                     for (i32 i = 0; i < Hull->FaceCount; ++i)
                     {
@@ -537,6 +540,85 @@ void RendererDrawFrame(render_group *RenderGroup)
                 Renderer.Context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
             } break;
 
+            case DEBUG_RenderCommandType_TriangleMesh:
+            {
+                DXUseShader(Renderer.DebugShader);
+                triangle_mesh *Mesh = Cmd->DEBUGTriangleMesh.Mesh;
+                Renderer.Context->Map(Renderer.ScratchVertexBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &Subresource);
+                debug_vertex *Buffer = (debug_vertex*)Subresource.pData;
+
+                // Every triangle is drawn with its own three lines, limited by the size of the scratch buffer.
+                i32 MaxTriangles = 16384 / 6;
+                i32 TriangleCount = Mesh->TriangleCount < MaxTriangles ? Mesh->TriangleCount : MaxTriangles;
+                for (i32 i = 0; i < TriangleCount; ++i)
+                {
+                    v3 Corners[3];
+                    GetMeshTriangle(Mesh, i, Corners + 0, Corners + 1, Corners + 2);
+                    for (i32 k = 0; k < 3; ++k)
+                    {
+                        // Internal edges are dimmed.
+                        v3 Color = (Mesh->EdgeFlags[i] & (1 << k)) ? V3(1,1,1) : V3(0.4f,0.4f,0.4f);
+                        *Buffer++ = {Corners[k], Color};
+                        *Buffer++ = {Corners[(k + 1) % 3], Color};
+                    }
+                }
+                Renderer.Context->Unmap(Renderer.ScratchVertexBuffer, 0);
+                ConstantBuffer.Model =
+                    Translation(Cmd->DEBUGTriangleMesh.Transform.Position) *
+                    RotationMatrix(Cmd->DEBUGTriangleMesh.Transform.Rotation);
+                ConstantBuffer.ViewProjection = ViewProjection;
+                DXLoadConstantBuffer(&ConstantBuffer);
+
+                u32 DebugStride = sizeof(debug_vertex);
+                Renderer.Context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_LINELIST);
+                Renderer.Context->IASetVertexBuffers(0, 1, &Renderer.ScratchVertexBuffer, &DebugStride, &Offset);
+                Renderer.Context->Draw(TriangleCount * 6, 0);
+                Renderer.Context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+                DXUseShader(Renderer.Shader);
+            } break;
+
+            case DEBUG_RenderCommandType_Heightfield:
+            {
+                DXUseShader(Renderer.DebugShader);
+                heightfield *Field = Cmd->DEBUGHeightfield.Heightfield;
+                Renderer.Context->Map(Renderer.ScratchVertexBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &Subresource);
+                debug_vertex *Buffer = (debug_vertex*)Subresource.pData;
+
+                // Grid lines along x and y from every sample, limited by the size of the scratch buffer.
+                i32 VertexCount = 0;
+                v3 Color = V3(0.6f, 0.8f, 0.4f);
+                for (i32 y = 0; y < Field->SamplesY; ++y)
+                {
+                    for (i32 x = 0; x < Field->SamplesX && VertexCount + 4 <= 16384; ++x)
+                    {
+                        v3 P = GetHeightfieldPoint(Field, x, y);
+                        if (x + 1 < Field->SamplesX)
+                        {
+                            Buffer[VertexCount++] = {P, Color};
+                            Buffer[VertexCount++] = {GetHeightfieldPoint(Field, x + 1, y), Color};
+                        }
+                        if (y + 1 < Field->SamplesY)
+                        {
+                            Buffer[VertexCount++] = {P, Color};
+                            Buffer[VertexCount++] = {GetHeightfieldPoint(Field, x, y + 1), Color};
+                        }
+                    }
+                }
+                Renderer.Context->Unmap(Renderer.ScratchVertexBuffer, 0);
+                ConstantBuffer.Model =
+                    Translation(Cmd->DEBUGHeightfield.Transform.Position) *
+                    RotationMatrix(Cmd->DEBUGHeightfield.Transform.Rotation);
+                ConstantBuffer.ViewProjection = ViewProjection;
+                DXLoadConstantBuffer(&ConstantBuffer);
+
+                u32 DebugStride = sizeof(debug_vertex);
+                Renderer.Context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_LINELIST);
+                Renderer.Context->IASetVertexBuffers(0, 1, &Renderer.ScratchVertexBuffer, &DebugStride, &Offset);
+                Renderer.Context->Draw(VertexCount, 0);
+                Renderer.Context->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+                DXUseShader(Renderer.Shader);
+            } break;
+
             default: ASSERT(false);
         }
     }
@@ -0,0 +1,150 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <emmintrin.h>
+
+// 4 wide versions of the scalar math types, one lane per constraint. Only SSE2 is used
+// since it's always available on x64.
+
+struct f32_4x
+{
+    __m128 V;
+};
+
+inline f32_4x F32_4x(float A)
+{
+    f32_4x Result = {_mm_set1_ps(A)};
+    return Result;
+}
+
+inline f32_4x LoadF32_4x(float *Values)
+{
+    f32_4x Result = {_mm_load_ps(Values)};
+    return Result;
+}
+
+inline void StoreF32_4x(float *Values, f32_4x A)
+{
+    _mm_store_ps(Values, A.V);
+}
+
+inline f32_4x operator+(f32_4x A, f32_4x B)
+{
+    f32_4x Result = {_mm_add_ps(A.V, B.V)};
+    return Result;
+}
+
+inline f32_4x operator-(f32_4x A, f32_4x B)
+{
+    f32_4x Result = {_mm_sub_ps(A.V, B.V)};
+    return Result;
+}
+
+inline f32_4x operator-(f32_4x A)
+{
+    f32_4x Result = {_mm_sub_ps(_mm_setzero_ps(), A.V)};
+    return Result;
+}
+
+inline f32_4x operator*(f32_4x A, f32_4x B)
+{
+    f32_4x Result = {_mm_mul_ps(A.V, B.V)};
+    return Result;
+}
+
+inline f32_4x operator/(f32_4x A, f32_4x B)
+{
+    f32_4x Result = {_mm_div_ps(A.V, B.V)};
+    return Result;
+}
+
+inline f32_4x SquareRoot(f32_4x A)
+{
+    f32_4x Result = {_mm_sqrt_ps(A.V)};
+    return Result;
+}
+
+inline f32_4x Abs(f32_4x A)
+{
+    f32_4x Result = {_mm_andnot_ps(_mm_set1_ps(-0.f), A.V)};
+    return Result;
+}
+
+inline f32_4x Min(f32_4x A, f32_4x B)
+{
+    f32_4x Result = {_mm_min_ps(A.V, B.V)};
+    return Result;
+}
+
+inline f32_4x Max(f32_4x A, f32_4x B)
+{
+    f32_4x Result = {_mm_max_ps(A.V, B.V)};
+    return Result;
+}
+
+inline f32_4x Clamp(f32_4x A, f32_4x Lo, f32_4x Hi)
+{
+    return Min(Max(A, Lo), Hi);
+}
+
+inline float HorizontalMax(f32_4x A)
+{
+    __m128 M = _mm_max_ps(A.V, _mm_shuffle_ps(A.V, A.V, _MM_SHUFFLE(2, 3, 0, 1)));
+    M = _mm_max_ps(M, _mm_shuffle_ps(M, M, _MM_SHUFFLE(1, 0, 3, 2)));
+    return _mm_cvtss_f32(M);
+}
+
+struct v3_4x
+{
+    f32_4x x;
+    f32_4x y;
+    f32_4x z;
+};
+
+inline v3_4x operator+(v3_4x A, v3_4x B)
+{
+    v3_4x Result = {A.x + B.x, A.y + B.y, A.z + B.z};
+    return Result;
+}
+
+inline v3_4x operator-(v3_4x A, v3_4x B)
+{
+    v3_4x Result = {A.x - B.x, A.y - B.y, A.z - B.z};
+    return Result;
+}
+
+inline v3_4x operator*(v3_4x A, f32_4x S)
+{
+    v3_4x Result = {A.x * S, A.y * S, A.z * S};
+    return Result;
+}
+
+inline f32_4x Dot(v3_4x A, v3_4x B)
+{
+    return A.x * B.x + A.y * B.y + A.z * B.z;
+}
+
+inline v3_4x Cross(v3_4x A, v3_4x B)
+{
+    v3_4x Result;
+    Result.x = A.y * B.z - A.z * B.y;
+    Result.y = A.z * B.x - A.x * B.z;
+    Result.z = A.x * B.y - A.y * B.x;
+    return Result;
+}
+
+struct m3x3_4x
+{
+    f32_4x e[3][3];
+};
+
+inline v3_4x operator*(m3x3_4x &M, v3_4x V)
+{
+    v3_4x Result;
+    Result.x = M.e[0][0] * V.x + M.e[0][1] * V.y + M.e[0][2] * V.z;
+    Result.y = M.e[1][0] * V.x + M.e[1][1] * V.y + M.e[1][2] * V.z;
+    Result.z = M.e[2][0] * V.x + M.e[2][1] * V.y + M.e[2][2] * V.z;
+    return Result;
+}
+
+#endif
@@ -0,0 +1,431 @@
+//
+// Static triangle meshes for level geometry. The tree is built once and only ever read,
+// so nodes are quantized to 16 bits and stored depth first in a single array.
+//
+
+#define TRIANGLE_MESH_LEAF_SIZE 4
+
+// A single triangle as a flat hull with a front and a back face, so that it can go
+// through the same SAT and clipping code as any other hull.
+struct triangle_hull
+{
+    hull Hull;
+    v3 Vertices[3];
+    half_edge Edges[6];
+    face Faces[2];
+    plane Planes[2];
+};
+
+void InitTriangleHull(triangle_hull *Triangle, v3 A, v3 B, v3 C)
+{
+    hull *Hull = &Triangle->Hull;
+    Hull->Centroid = (A + B + C) / 3.f;
+    Hull->VertexCount = 3;
+    Hull->Vertices = Triangle->Vertices;
+    Hull->EdgeCount = 6;
+    Hull->Edges = Triangle->Edges;
+    Hull->FaceCount = 2;
+    Hull->Faces = Triangle->Faces;
+    Hull->Planes = Triangle->Planes;
+
+    Triangle->Vertices[0] = A;
+    Triangle->Vertices[1] = B;
+    Triangle->Vertices[2] = C;
+
+    // Edge 2k runs from vertex k to k+1 around the front face, its twin 2k+1 runs
+    // the other way around the back face.
+    for (i32 k = 0; k < 3; ++k)
+    {
+        half_edge *Edge = Triangle->Edges + 2*k;
+        Edge->Origin = (u16)k;
+        Edge->Twin = (u16)(2*k + 1);
+        Edge->Face = 0;
+        Edge->Next = (u16)(2*((k + 1) % 3));
+
+        half_edge *Twin = Triangle->Edges + 2*k + 1;
+        Twin->Origin = (u16)((k + 1) % 3);
+        Twin->Twin = (u16)(2*k);
+        Twin->Face = 1;
+        Twin->Next = (u16)(2*((k + 2) % 3) + 1);
+    }
+
+    Triangle->Faces[0].Edge = 0;
+    Triangle->Faces[1].Edge = 1;
+    Triangle->Planes[0] = PlaneFromPoints(A, B, C);
+    Triangle->Planes[1].Normal = -Triangle->Planes[0].Normal;
+    Triangle->Planes[1].Distance = -Triangle->Planes[0].Distance;
+}
+
+inline void GetMeshTriangle(triangle_mesh *Mesh, i32 Triangle, v3 *A, v3 *B, v3 *C)
+{
+    u32 *Indices = Mesh->Indices + 3*Triangle;
+    *A = Mesh->Vertices[Indices[0]];
+    *B = Mesh->Vertices[Indices[1]];
+    *C = Mesh->Vertices[Indices[2]];
+}
+
+// Min is rounded down and Max up, so the quantized box always contains the original.
+inline void QuantizeBounds(triangle_mesh *Mesh, aabb Bounds, u16 *Min, u16 *Max)
+{
+    for (i32 Axis = 0; Axis < 3; ++Axis)
+    {
+        float Lo = (Bounds.Min[Axis] - Mesh->Bounds.Min[Axis]) * Mesh->QuantizationScale[Axis];
+        float Hi = (Bounds.Max[Axis] - Mesh->Bounds.Min[Axis]) * Mesh->QuantizationScale[Axis];
+        Min[Axis] = (u16)Clamp(floorf(Lo), 0.f, 65535.f);
+        Max[Axis] = (u16)Clamp(ceilf(Hi), 0.f, 65535.f);
+    }
+}
+
+inline aabb DequantizeBounds(triangle_mesh *Mesh, triangle_mesh_node *Node)
+{
+    aabb Result;
+    for (i32 Axis = 0; Axis < 3; ++Axis)
+    {
+        Result.Min[Axis] = Mesh->Bounds.Min[Axis] + Node->QuantizedMin[Axis] / Mesh->QuantizationScale[Axis];
+        Result.Max[Axis] = Mesh->Bounds.Min[Axis] + Node->QuantizedMax[Axis] / Mesh->QuantizationScale[Axis];
+    }
+    return Result;
+}
+
+// Moves the triangle with the median centroid on the axis to the middle, with smaller ones before it.
+static void PartitionTriangles(i32 *Triangles, i32 Count, v3 *Centroids, i32 Axis)
+{
+    i32 Lo = 0;
+    i32 Hi = Count - 1;
+    i32 Median = Count / 2;
+    while (Lo < Hi)
+    {
+        float Pivot = Centroids[Triangles[(Lo + Hi) / 2]][Axis];
+        i32 i = Lo;
+        i32 j = Hi;
+        while (i <= j)
+        {
+            while (Centroids[Triangles[i]][Axis] < Pivot) ++i;
+            while (Centroids[Triangles[j]][Axis] > Pivot) --j;
+            if (i <= j)
+            {
+                i32 Temp = Triangles[i];
+                Triangles[i] = Triangles[j];
+                Triangles[j] = Temp;
+                ++i;
+                --j;
+            }
+        }
+
+        if (Median <= j) Hi = j;
+        else if (Median >= i) Lo = i;
+        else break;
+    }
+}
+
+static i32 BuildTriangleMeshNode(triangle_mesh *Mesh, v3 *Vertices, u32 *Indices, v3 *Centroids,
+                                 i32 *Triangles, i32 First, i32 Count)
+{
+    i32 NodeIndex = Mesh->NodeCount++;
+
+    aabb Bounds;
+    aabb CentroidBounds;
+    Bounds.Min = CentroidBounds.Min = V3(FLT_MAX, FLT_MAX, FLT_MAX);
+    Bounds.Max = CentroidBounds.Max = -Bounds.Min;
+    for (i32 i = First; i < First + Count; ++i)
+    {
+        i32 Triangle = Triangles[i];
+        for (i32 Axis = 0; Axis < 3; ++Axis)
+        {
+            for (i32 k = 0; k < 3; ++k)
+            {
+                float Value = Vertices[Indices[3*Triangle + k]][Axis];
+                Bounds.Min[Axis] = Min(Bounds.Min[Axis], Value);
+                Bounds.Max[Axis] = Max(Bounds.Max[Axis], Value);
+            }
+            CentroidBounds.Min[Axis] = Min(CentroidBounds.Min[Axis], Centroids[Triangle][Axis]);
+            CentroidBounds.Max[Axis] = Max(CentroidBounds.Max[Axis], Centroids[Triangle][Axis]);
+        }
+    }
+
+    triangle_mesh_node *Node = Mesh->Nodes + NodeIndex;
+    QuantizeBounds(Mesh, Bounds, Node->QuantizedMin, Node->QuantizedMax);
+    Node->Padding = 0;
+
+    if (Count <= TRIANGLE_MESH_LEAF_SIZE)
+    {
+        Node->TriangleCount = (u16)Count;
+        Node->Index = First;
+        return NodeIndex;
+    }
+
+    v3 Size = CentroidBounds.Max - CentroidBounds.Min;
+    i32 Axis = 0;
+    if (Size[1] > Size[Axis]) Axis = 1;
+    if (Size[2] > Size[Axis]) Axis = 2;
+
+    PartitionTriangles(Triangles + First, Count, Centroids, Axis);
+
+    i32 LeftCount = Count / 2;
+    Node->TriangleCount = 0;
+    BuildTriangleMeshNode(Mesh, Vertices, Indices, Centroids, Triangles, First, LeftCount);
+    i32 RightNode = BuildTriangleMeshNode(Mesh, Vertices, Indices, Centroids, Triangles,
+                                          First + LeftCount, Count - LeftCount);
+    Mesh->Nodes[NodeIndex].Index = RightNode;
+    return NodeIndex;
+}
+
+// An edge is internal when the neighbouring triangle is coplanar or folds upwards, in
+// both cases the neighbour already produces the right contact. The edge runs from Start
+// to End on the triangle, the neighbour has it the other way around.
+inline bool IsActiveEdge(v3 Normal, v3 Start, v3 End, v3 NeighbourOpposite)
+{
+    float FlatCosine = 0.9998f;
+    float ConvexEpsilon = 0.001f;
+
+    v3 NeighbourNormal = Cross(Start - End, NeighbourOpposite - End);
+    if (IsZeroVector(NeighbourNormal))
+    {
+        return true;
+    }
+    NeighbourNormal = Normalized(NeighbourNormal);
+
+    bool IsFlat = Dot(Normal, NeighbourNormal) > FlatCosine;
+    bool IsConvex = Dot(Normal, NeighbourOpposite - Start) < -ConvexEpsilon * Length(End - Start);
+    return !IsFlat && IsConvex;
+}
+
+static void ComputeTriangleEdgeFlags(triangle_mesh *Mesh, arena *Scratch)
+{
+    for (i32 Triangle = 0; Triangle < Mesh->TriangleCount; ++Triangle)
+    {
+        Mesh->EdgeFlags[Triangle] = TriangleEdge_Active0 | TriangleEdge_Active1 | TriangleEdge_Active2;
+    }
+
+    u32 MapSize = 1;
+    while (MapSize < (u32)Mesh->TriangleCount * 6)
+    {
+        MapSize <<= 1;
+    }
+    u64 *MapKeys = ArenaPushArray(Scratch, MapSize, u64);
+    i32 *MapEdges = ArenaPushArray(Scratch, MapSize, i32);
+
+    for (i32 Triangle = 0; Triangle < Mesh->TriangleCount; ++Triangle)
+    {
+        for (i32 k = 0; k < 3; ++k)
+        {
+            u32 A = Mesh->Indices[3*Triangle + k];
+            u32 B = Mesh->Indices[3*Triangle + (k + 1) % 3];
+            u64 Key = ((u64)(A < B ? A : B) << 32) | (u64)(A < B ? B : A);
+            u32 Slot = (u32)((Key * 0x9E3779B97F4A7C15ull) >> 32) & (MapSize - 1);
+            while (MapKeys[Slot] != 0 && MapKeys[Slot] != Key + 1)
+            {
+                Slot = (Slot + 1) & (MapSize - 1);
+            }
+
+            if (MapKeys[Slot] == 0)
+            {
+                MapKeys[Slot] = Key + 1;
+                MapEdges[Slot] = 3*Triangle + k;
+                continue;
+            }
+
+            // Only the first two triangles on an edge are compared.
+            i32 Other = MapEdges[Slot];
+            if (Other < 0)
+            {
+                continue;
+            }
+            MapEdges[Slot] = -1;
+
+            i32 OtherTriangle = Other / 3;
+            i32 OtherEdge = Other % 3;
+
+            v3 V0, V1, V2;
+            GetMeshTriangle(Mesh, Triangle, &V0, &V1, &V2);
+            v3 Normal = Cross(V1 - V0, V2 - V0);
+            if (IsZeroVector(Normal))
+            {
+                continue;
+            }
+
+            v3 Opposite = Mesh->Vertices[Mesh->Indices[3*OtherTriangle + (OtherEdge + 2) % 3]];
+            if (!IsActiveEdge(Normalized(Normal), Mesh->Vertices[A], Mesh->Vertices[B], Opposite))
+            {
+                Mesh->EdgeFlags[Triangle] &= ~(1 << k);
+                Mesh->EdgeFlags[OtherTriangle] &= ~(1 << OtherEdge);
+            }
+        }
+    }
+}
+
+// Indices are three per triangle, front faces wind counter clockwise.
+triangle_mesh *BuildTriangleMesh(arena *Arena, v3 *Vertices, i32 VertexCount, u32 *Indices, i32 TriangleCount)
+{
+    ASSERT(TriangleCount > 0);
+
+    triangle_mesh *Mesh = ArenaPushType(Arena, triangle_mesh);
+    Mesh->VertexCount = VertexCount;
+    Mesh->Vertices = ArenaPushArray(Arena, VertexCount, v3);
+    memcpy(Mesh->Vertices, Vertices, VertexCount * sizeof(v3));
+    Mesh->TriangleCount = TriangleCount;
+
+    Mesh->Bounds.Min = V3(FLT_MAX, FLT_MAX, FLT_MAX);
+    Mesh->Bounds.Max = -Mesh->Bounds.Min;
+    for (i32 i = 0; i < VertexCount; ++i)
+    {
+        for (i32 Axis = 0; Axis < 3; ++Axis)
+        {
+            Mesh->Bounds.Min[Axis] = Min(Mesh->Bounds.Min[Axis], Vertices[i][Axis]);
+            Mesh->Bounds.Max[Axis] = Max(Mesh->Bounds.Max[Axis], Vertices[i][Axis]);
+        }
+    }
+    for (i32 Axis = 0; Axis < 3; ++Axis)
+    {
+        float Extent = Max(Mesh->Bounds.Max[Axis] - Mesh->Bounds.Min[Axis], ML_EPSILON);
+        Mesh->QuantizationScale[Axis] = 65535.f / Extent;
+    }
+
+    temporary_memory Temp = BeginTemporaryMemory(TemporaryArena());
+    v3 *Centroids = ArenaPushArray(TemporaryArena(), TriangleCount, v3);
+    i32 *Triangles = ArenaPushArray(TemporaryArena(), TriangleCount, i32);
+    for (i32 i = 0; i < TriangleCount; ++i)
+    {
+        Centroids[i] = (Vertices[Indices[3*i]] + Vertices[Indices[3*i + 1]] + Vertices[Indices[3*i + 2]]) / 3.f;
+        Triangles[i] = i;
+    }
+
+    // Build into scratch memory first since the final node count isn't known up front.
+    i32 MaxNodes = 2 * TriangleCount;
+    Mesh->Nodes = ArenaPushArray(TemporaryArena(), MaxNodes, triangle_mesh_node);
+    BuildTriangleMeshNode(Mesh, Vertices, Indices, Centroids, Triangles, 0, TriangleCount);
+    ASSERT(Mesh->NodeCount <= MaxNodes);
+
+    triangle_mesh_node *Nodes = ArenaPushArray(Arena, Mesh->NodeCount, triangle_mesh_node);
+    memcpy(Nodes, Mesh->Nodes, Mesh->NodeCount * sizeof(triangle_mesh_node));
+    Mesh->Nodes = Nodes;
+
+    // Store the triangles in leaf order.
+    Mesh->Indices = ArenaPushArray(Arena, 3 * TriangleCount, u32);
+    for (i32 i = 0; i < TriangleCount; ++i)
+    {
+        for (i32 k = 0; k < 3; ++k)
+        {
+            Mesh->Indices[3*i + k] = Indices[3*Triangles[i] + k];
+        }
+    }
+
+    Mesh->EdgeFlags = ArenaPushArray(Arena, TriangleCount, u8);
+    ComputeTriangleEdgeFlags(Mesh, TemporaryArena());
+
+    EndTemporaryMemory(Temp);
+    return Mesh;
+}
+
+// Bounds are in the local space of the mesh. Returns the number of overlapping triangles,
+// only the first MaxTriangles of them are written.
+i32 QueryTriangleMesh(triangle_mesh *Mesh, aabb Bounds, i32 *Triangles, i32 MaxTriangles)
+{
+    if (!IntersectAABBAABB(Mesh->Bounds, Bounds))
+    {
+        return 0;
+    }
+
+    u16 QueryMin[3];
+    u16 QueryMax[3];
+    QuantizeBounds(Mesh, Bounds, QueryMin, QueryMax);
+
+    i32 Count = 0;
+    i32 StackCount = 0;
+    i32 Stack[64];
+    Stack[StackCount++] = 0;
+    while (StackCount > 0)
+    {
+        i32 NodeIndex = Stack[--StackCount];
+        triangle_mesh_node *Node = Mesh->Nodes + NodeIndex;
+        if (Node->QuantizedMax[0] < QueryMin[0] || Node->QuantizedMin[0] > QueryMax[0] ||
+            Node->QuantizedMax[1] < QueryMin[1] || Node->QuantizedMin[1] > QueryMax[1] ||
+            Node->QuantizedMax[2] < QueryMin[2] || Node->QuantizedMin[2] > QueryMax[2])
+        {
+            continue;
+        }
+
+        if (Node->TriangleCount > 0)
+        {
+            for (i32 i = 0; i < Node->TriangleCount; ++i)
+            {
+                if (Count < MaxTriangles)
+                {
+                    Triangles[Count] = Node->Index + i;
+                }
+                Count++;
+            }
+        }
+        else
+        {
+            ASSERT(StackCount + 2 <= ARRAY_SIZE(Stack));
+            Stack[StackCount++] = Node->Index;
+            Stack[StackCount++] = NodeIndex + 1;
+        }
+    }
+    return Count;
+}
+
+// Contacts from SAT may use the normal of an internal edge, which makes bodies sliding
+// across the mesh bump into edges that aren't there. Those contacts are rebuilt against
+// the triangle face. Returns false if the contact should be dropped.
+bool FixInternalEdgeContact(u8 EdgeFlags, triangle_hull *Triangle, transform T,
+                            rigid_body *Body, transform BodyTransform, contact_manifold *Manifold)
+{
+    // The manifold normal points from the body towards the triangle.
+    v3 FaceNormal = RotateVector(Triangle->Planes[0].Normal, T.Rotation);
+    float Cosine = -Dot(Manifold->Normal, FaceNormal);
+    if (Cosine > 0.9999f)
+    {
+        return true;
+    }
+
+    contact_point *Deepest = Manifold->Points;
+    for (i32 i = 1; i < Manifold->PointCount; ++i)
+    {
+        if (Manifold->Points[i].Penetration < Deepest->Penetration)
+        {
+            Deepest = Manifold->Points + i;
+        }
+    }
+
+    // Keep the contact if it is on an active edge.
+    v3 P = PointToLocalSpace(Deepest->Position, T);
+    P = ProjectPointOnPlane(Triangle->Planes[0], P);
+    float Tolerance = Max(-Deepest->Penetration, 0.f) + 0.01f;
+    for (i32 k = 0; k < 3; ++k)
+    {
+        v3 EdgeStart = Triangle->Vertices[k];
+        v3 EdgeEnd = Triangle->Vertices[(k + 1) % 3];
+        float DistanceSq = LengthSquared(ClosestPointSegment(P, EdgeStart, EdgeEnd) - P);
+        if ((EdgeFlags & (1 << k)) && DistanceSq <= Square(Tolerance))
+        {
+            return true;
+        }
+    }
+
+    if (Body->ShapeType == ShapeType_Hull)
+    {
+        face_query FaceQuery;
+        FaceQuery.Index = 0;
+        FaceQuery.Normal = FaceNormal;
+        FaceQuery.Separation = 0.f;
+
+        memset(Manifold, 0, sizeof(*Manifold));
+        BuildFaceContact(FaceQuery, &Triangle->Hull, V3(1,1,1), T, Body->Hull, Body->Scale, BodyTransform, Manifold);
+        Manifold->Normal = -Manifold->Normal;
+        return Manifold->PointCount > 0;
+    }
+
+    // Other shapes keep their points and only move the penetration onto the face normal.
+    if (Cosine <= 0.f)
+    {
+        return false;
+    }
+    Manifold->Normal = -FaceNormal;
+    for (i32 i = 0; i < Manifold->PointCount; ++i)
+    {
+        Manifold->Points[i].Penetration *= Cosine;
+    }
+    return true;
+}